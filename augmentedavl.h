@@ -0,0 +1,565 @@
+#ifndef AUGMENTEDAVL_H
+#define AUGMENTEDAVL_H
+
+#include <iostream>
+#include <cstdlib>
+#include <limits>
+#include <utility>
+#include <stdexcept>
+
+#include "avlbst.h"
+
+/**
+* Aggregation policies for AugmentedAVLTree. A policy names the type of
+* the aggregate, an identity, an associative combine, and lift(), which
+* turns one item into an aggregate. combine() need not be commutative;
+* the tree always combines in key order.
+*/
+template <typename T>
+struct SumAggregate
+{
+    typedef T value_type;
+    static T identity() { return T(); }
+    static T combine(const T& a, const T& b) { return a + b; }
+    template <typename Key>
+    static T lift(const Key&, const T& value) { return value; }
+};
+
+template <typename T>
+struct MinAggregate
+{
+    typedef T value_type;
+    static T identity() { return std::numeric_limits<T>::max(); }
+    static T combine(const T& a, const T& b) { return b < a ? b : a; }
+    template <typename Key>
+    static T lift(const Key&, const T& value) { return value; }
+};
+
+template <typename T>
+struct MaxAggregate
+{
+    typedef T value_type;
+    static T identity() { return std::numeric_limits<T>::lowest(); }
+    static T combine(const T& a, const T& b) { return a < b ? b : a; }
+    template <typename Key>
+    static T lift(const Key&, const T& value) { return value; }
+};
+
+/**
+* An AVLNode that also holds the aggregate of its whole subtree.
+*/
+template <typename Key, typename Value, typename Aggregate>
+class AugmentedAVLNode : public AVLNode<Key, Value>
+{
+public:
+    AugmentedAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual ~AugmentedAVLNode();
+
+    const Aggregate& getAggregate() const;
+    void setAggregate(const Aggregate& aggregate);
+    virtual size_t nodeSize() const override;
+    virtual Node<Key, Value>* copyTo(void* where) const override;
+
+protected:
+    Aggregate aggregate_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the AugmentedAVLNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value, class Aggregate>
+AugmentedAVLNode<Key, Value, Aggregate>::AugmentedAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent), aggregate_()
+{
+
+}
+
+template<class Key, class Value, class Aggregate>
+AugmentedAVLNode<Key, Value, Aggregate>::~AugmentedAVLNode()
+{
+
+}
+
+template<class Key, class Value, class Aggregate>
+const Aggregate& AugmentedAVLNode<Key, Value, Aggregate>::getAggregate() const
+{
+    return aggregate_;
+}
+
+template<class Key, class Value, class Aggregate>
+void AugmentedAVLNode<Key, Value, Aggregate>::setAggregate(const Aggregate& aggregate)
+{
+    aggregate_ = aggregate;
+}
+
+/**
+* Overridden so compact() copies the whole AugmentedAVLNode.
+*/
+template<class Key, class Value, class Aggregate>
+size_t AugmentedAVLNode<Key, Value, Aggregate>::nodeSize() const
+{
+    return sizeof(AugmentedAVLNode<Key, Value, Aggregate>);
+}
+
+template<class Key, class Value, class Aggregate>
+Node<Key, Value>* AugmentedAVLNode<Key, Value, Aggregate>::copyTo(void* where) const
+{
+    return new (where) AugmentedAVLNode<Key, Value, Aggregate>(*this);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the AugmentedAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVLTree that keeps Policy's aggregate of every subtree in its root,
+* so aggregate(lo, hi) combines O(log n) stored values instead of
+* visiting every item in the range.
+*
+* The aggregates follow inserts, overwrites, removes, node handles,
+* range erases and compaction. Every way to change a value in place goes
+* through assign(): the iterators only give const access, and operator[]
+* returns a reference object whose assignment refreshes the aggregates.
+* AVLTree is a protected base, so its writable iterators and operator[]
+* cannot be reached through a base reference either; the parts of its
+* interface that leave values alone are made public again below.
+*/
+template <class Key, class Value, class Policy>
+class AugmentedAVLTree : protected AVLTree<Key, Value>
+{
+public:
+    typedef typename BinarySearchTree<Key, Value>::key_type key_type;
+    typedef typename BinarySearchTree<Key, Value>::mapped_type mapped_type;
+    typedef typename Policy::value_type aggregate_type;
+    typedef NodeHandle<Key, Value, AugmentedAVLNode<Key, Value, aggregate_type> > node_handle;
+
+    /**
+    * An iterator with only const access to the items. It converts from
+    * the plain iterator, which the tree keeps to itself.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+        iterator(const typename AVLTree<Key, Value>::iterator& it);
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class AugmentedAVLTree<Key, Value, Policy>;
+        typename AVLTree<Key, Value>::iterator it_;
+    };
+
+    /**
+    * What operator[] returns: it reads as the value, and assigning to it
+    * overwrites the value and refreshes the aggregates above it.
+    */
+    class reference
+    {
+    public:
+        operator const Value&() const;
+        reference& operator=(const Value& value);
+        reference& operator=(const reference& other);
+
+    protected:
+        friend class AugmentedAVLTree<Key, Value, Policy>;
+        reference(AugmentedAVLTree<Key, Value, Policy>* tree, AVLNode<Key, Value>* node);
+        AugmentedAVLTree<Key, Value, Policy>* tree_;
+        AVLNode<Key, Value>* node_;
+    };
+
+    aggregate_type aggregate() const;
+    aggregate_type aggregate(const Key& lo, const Key& hi) const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator find(iterator hint, const Key& key) const;
+    reference operator[](const Key& key);
+    const Value& operator[](const Key& key) const;
+
+    virtual void insert(const std::pair<const Key, Value>& new_item);
+    iterator insert(iterator hint, const std::pair<const Key, Value>& new_item);
+    std::pair<iterator, bool> insert(node_handle&& nh);
+    node_handle extract(const Key& key);
+    iterator erase(iterator pos);
+    size_t erase(const Key& lo, const Key& hi);
+    iterator erase(iterator first, iterator last);
+    void swap(AugmentedAVLTree& other);
+
+    using AVLTree<Key, Value>::remove;
+    using AVLTree<Key, Value>::clear;
+    using AVLTree<Key, Value>::empty;
+    using AVLTree<Key, Value>::size;
+    using AVLTree<Key, Value>::isBalanced;
+    using AVLTree<Key, Value>::rotations;
+    using AVLTree<Key, Value>::rebalance;
+    using AVLTree<Key, Value>::setAutoRebalance;
+    using AVLTree<Key, Value>::compact;
+    using AVLTree<Key, Value>::setHashIndex;
+    using AVLTree<Key, Value>::hashIndexBytes;
+    using AVLTree<Key, Value>::setBloomFilter;
+    using AVLTree<Key, Value>::bloomFilterBytes;
+    using AVLTree<Key, Value>::stats;
+    using AVLTree<Key, Value>::resetStats;
+    using AVLTree<Key, Value>::shapeStats;
+    using AVLTree<Key, Value>::print;
+    using AVLTree<Key, Value>::exportDot;
+    using AVLTree<Key, Value>::exportJson;
+
+protected:
+    typedef AugmentedAVLNode<Key, Value, aggregate_type> AggNode;
+
+    virtual AVLNode<Key, Value>* makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual const std::type_info& nodeType() const;
+    virtual void link(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* node, bool left);
+    virtual Node<Key, Value>* detach(Node<Key, Value>* n);
+    virtual void nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2);
+    virtual void refresh(AVLNode<Key, Value>* node);
+    virtual void assign(AVLNode<Key, Value>* node, const Value& value);
+
+    void refreshUp(AVLNode<Key, Value>* node);
+    static aggregate_type aggregateOf(Node<Key, Value>* node);
+    static aggregate_type lift(Node<Key, Value>* node);
+};
+
+/*
+  -------------------------------------------------------------
+  Begin implementations for the AugmentedAVLTree::iterator and
+  AugmentedAVLTree::reference classes.
+  -------------------------------------------------------------
+*/
+
+template<class Key, class Value, class Policy>
+AugmentedAVLTree<Key, Value, Policy>::iterator::iterator()
+{
+
+}
+
+template<class Key, class Value, class Policy>
+AugmentedAVLTree<Key, Value, Policy>::iterator::iterator(const typename AVLTree<Key, Value>::iterator& it) :
+    it_(it)
+{
+
+}
+
+template<class Key, class Value, class Policy>
+const std::pair<const Key, Value>&
+AugmentedAVLTree<Key, Value, Policy>::iterator::operator*() const
+{
+    return *it_;
+}
+
+template<class Key, class Value, class Policy>
+const std::pair<const Key, Value>*
+AugmentedAVLTree<Key, Value, Policy>::iterator::operator->() const
+{
+    return it_.operator->();
+}
+
+template<class Key, class Value, class Policy>
+bool AugmentedAVLTree<Key, Value, Policy>::iterator::operator==(const iterator& rhs) const
+{
+    return it_ == rhs.it_;
+}
+
+template<class Key, class Value, class Policy>
+bool AugmentedAVLTree<Key, Value, Policy>::iterator::operator!=(const iterator& rhs) const
+{
+    return it_ != rhs.it_;
+}
+
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::iterator&
+AugmentedAVLTree<Key, Value, Policy>::iterator::operator++()
+{
+    ++it_;
+    return *this;
+}
+
+template<class Key, class Value, class Policy>
+AugmentedAVLTree<Key, Value, Policy>::reference::reference(AugmentedAVLTree<Key, Value, Policy>* tree,
+                                                           AVLNode<Key, Value>* node) :
+    tree_(tree), node_(node)
+{
+
+}
+
+template<class Key, class Value, class Policy>
+AugmentedAVLTree<Key, Value, Policy>::reference::operator const Value&() const
+{
+    return node_->getValue();
+}
+
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::reference&
+AugmentedAVLTree<Key, Value, Policy>::reference::operator=(const Value& value)
+{
+    tree_->assign(node_, value);
+    return *this;
+}
+
+/**
+* Assigns the other item's value, as assigning a Value& would.
+*/
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::reference&
+AugmentedAVLTree<Key, Value, Policy>::reference::operator=(const reference& other)
+{
+    return *this = static_cast<const Value&>(other);
+}
+
+/*
+  -----------------------------------------------------------
+  End implementations for the AugmentedAVLTree::iterator and
+  AugmentedAVLTree::reference classes.
+  -----------------------------------------------------------
+*/
+
+/**
+* Returns the aggregate of every item, or the identity if there are none.
+*/
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::aggregate_type
+AugmentedAVLTree<Key, Value, Policy>::aggregate() const {
+    return aggregateOf(this->root_);
+}
+
+/**
+* Returns the aggregate of the items with lo <= key < hi, in key order.
+* Below the node where the searches for lo and hi part, every node on
+* the path to lo that is in range brings its right subtree along, and
+* every one on the path to hi its left subtree.
+*/
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::aggregate_type
+AugmentedAVLTree<Key, Value, Policy>::aggregate(const Key& lo, const Key& hi) const {
+    Node<Key, Value>* top = this->root_;
+    while (top != nullptr) {
+        if (top->getKey() < lo)
+            top = top->getRight();
+        else if (!(top->getKey() < hi))
+            top = top->getLeft();
+        else
+            break;
+    }
+    if (top == nullptr)
+        return Policy::identity();
+
+    aggregate_type below = Policy::identity();
+    for (Node<Key, Value>* node = top->getLeft(); node != nullptr; ) {
+        if (node->getKey() < lo) {
+            node = node->getRight();
+        } else {
+            below = Policy::combine(Policy::combine(lift(node), aggregateOf(node->getRight())), below);
+            node = node->getLeft();
+        }
+    }
+    aggregate_type above = Policy::identity();
+    for (Node<Key, Value>* node = top->getRight(); node != nullptr; ) {
+        if (!(node->getKey() < hi)) {
+            node = node->getLeft();
+        } else {
+            above = Policy::combine(above, Policy::combine(aggregateOf(node->getLeft()), lift(node)));
+            node = node->getRight();
+        }
+    }
+    return Policy::combine(below, Policy::combine(lift(top), above));
+}
+
+// The members from here to erase() only wrap AVLTree's in the const
+// iterator, or restate the overloads that those wrappers hide.
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::iterator
+AugmentedAVLTree<Key, Value, Policy>::begin() const {
+    return iterator(AVLTree<Key, Value>::begin());
+}
+
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::iterator
+AugmentedAVLTree<Key, Value, Policy>::end() const {
+    return iterator(AVLTree<Key, Value>::end());
+}
+
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::iterator
+AugmentedAVLTree<Key, Value, Policy>::find(const Key& key) const {
+    return iterator(AVLTree<Key, Value>::find(key));
+}
+
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::iterator
+AugmentedAVLTree<Key, Value, Policy>::find(iterator hint, const Key& key) const {
+    return iterator(AVLTree<Key, Value>::find(hint.it_, key));
+}
+
+/**
+* Returns a reference object for the key's value; assigning to it
+* refreshes the aggregates.
+* @throws std::out_of_range if the key is not in the tree
+*/
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::reference
+AugmentedAVLTree<Key, Value, Policy>::operator[](const Key& key) {
+    Node<Key, Value>* node = this->internalFind(key);
+    if (node == nullptr)
+        throw std::out_of_range("Invalid key");
+    return reference(this, static_cast<AVLNode<Key, Value>*>(node));
+}
+
+template<class Key, class Value, class Policy>
+const Value& AugmentedAVLTree<Key, Value, Policy>::operator[](const Key& key) const {
+    return AVLTree<Key, Value>::operator[](key);
+}
+
+template<class Key, class Value, class Policy>
+void AugmentedAVLTree<Key, Value, Policy>::insert(const std::pair<const Key, Value>& new_item) {
+    AVLTree<Key, Value>::insert(new_item);
+}
+
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::iterator
+AugmentedAVLTree<Key, Value, Policy>::insert(iterator hint, const std::pair<const Key, Value>& new_item) {
+    return iterator(AVLTree<Key, Value>::insert(hint.it_, new_item));
+}
+
+template<class Key, class Value, class Policy>
+std::pair<typename AugmentedAVLTree<Key, Value, Policy>::iterator, bool>
+AugmentedAVLTree<Key, Value, Policy>::insert(node_handle&& nh) {
+    std::pair<typename AVLTree<Key, Value>::iterator, bool> result = this->insertHandle(nh);
+    return std::make_pair(iterator(result.first), result.second);
+}
+
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::node_handle
+AugmentedAVLTree<Key, Value, Policy>::extract(const Key& key) {
+    return this->template extractHandle<node_handle>(key);
+}
+
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::iterator
+AugmentedAVLTree<Key, Value, Policy>::erase(iterator pos) {
+    return iterator(AVLTree<Key, Value>::erase(pos.it_));
+}
+
+template<class Key, class Value, class Policy>
+size_t AugmentedAVLTree<Key, Value, Policy>::erase(const Key& lo, const Key& hi) {
+    return AVLTree<Key, Value>::erase(lo, hi);
+}
+
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::iterator
+AugmentedAVLTree<Key, Value, Policy>::erase(iterator first, iterator last) {
+    return iterator(AVLTree<Key, Value>::erase(first.it_, last.it_));
+}
+
+template<class Key, class Value, class Policy>
+AVLNode<Key, Value>* AugmentedAVLTree<Key, Value, Policy>::makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) {
+    return this->template createNode<AggNode>(key, value, static_cast<AggNode*>(parent));
+}
+
+template<class Key, class Value, class Policy>
+const std::type_info& AugmentedAVLTree<Key, Value, Policy>::nodeType() const {
+    return typeid(AggNode);
+}
+
+/**
+* A new leaf adds its item to every subtree above it. The rotations
+* that follow refresh the nodes they move from these.
+*/
+template<class Key, class Value, class Policy>
+void AugmentedAVLTree<Key, Value, Policy>::link(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* node, bool left) {
+    AVLTree<Key, Value>::link(parent, node, left);
+    refreshUp(node);
+}
+
+/**
+* Refreshes the path from where n was unlinked up to the root. If n has
+* two children it first trades places with its predecessor, so it leaves
+* from there. The rotations on the way up may refresh a node before its
+* subtree is right, but each such node ends up on that path.
+*/
+template<class Key, class Value, class Policy>
+Node<Key, Value>* AugmentedAVLTree<Key, Value, Policy>::detach(Node<Key, Value>* n) {
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(n);
+    AVLNode<Key, Value>* from = node->getParent();
+    if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+        AVLNode<Key, Value>* pred = node->getLeft();
+        while (pred->getRight() != nullptr)
+            pred = pred->getRight();
+        from = pred->getParent() == node ? pred : pred->getParent();
+    }
+    AVLTree<Key, Value>::detach(n);
+    refreshUp(from);
+    return n;
+}
+
+/**
+* The nodes trade places but the aggregates belong to the places.
+*/
+template<class Key, class Value, class Policy>
+void AugmentedAVLTree<Key, Value, Policy>::nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2) {
+    AVLTree<Key, Value>::nodeSwap(n1, n2);
+    AggNode* a = static_cast<AggNode*>(n1);
+    AggNode* b = static_cast<AggNode*>(n2);
+    aggregate_type tmp = a->getAggregate();
+    a->setAggregate(b->getAggregate());
+    b->setAggregate(tmp);
+}
+
+template<class Key, class Value, class Policy>
+void AugmentedAVLTree<Key, Value, Policy>::refresh(AVLNode<Key, Value>* node) {
+    static_cast<AggNode*>(node)->setAggregate(
+        Policy::combine(Policy::combine(aggregateOf(node->getLeft()), lift(node)), aggregateOf(node->getRight())));
+}
+
+template<class Key, class Value, class Policy>
+void AugmentedAVLTree<Key, Value, Policy>::assign(AVLNode<Key, Value>* node, const Value& value) {
+    node->setValue(value);
+    refreshUp(node);
+}
+
+template<class Key, class Value, class Policy>
+void AugmentedAVLTree<Key, Value, Policy>::refreshUp(AVLNode<Key, Value>* node) {
+    for (; node != nullptr; node = node->getParent())
+        refresh(node);
+}
+
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::aggregate_type
+AugmentedAVLTree<Key, Value, Policy>::aggregateOf(Node<Key, Value>* node) {
+    return node == nullptr ? Policy::identity() : static_cast<AggNode*>(node)->getAggregate();
+}
+
+template<class Key, class Value, class Policy>
+typename AugmentedAVLTree<Key, Value, Policy>::aggregate_type
+AugmentedAVLTree<Key, Value, Policy>::lift(Node<Key, Value>* node) {
+    return Policy::lift(node->getKey(), node->getValue());
+}
+
+/**
+* Exchanges the contents of two trees in O(1); the aggregates are kept
+* in the nodes, so they go along.
+*/
+template<class Key, class Value, class Policy>
+void AugmentedAVLTree<Key, Value, Policy>::swap(AugmentedAVLTree& other) {
+    this->swapTrees(other);
+}
+
+template<class Key, class Value, class Policy>
+void swap(AugmentedAVLTree<Key, Value, Policy>& a, AugmentedAVLTree<Key, Value, Policy>& b) {
+    a.swap(b);
+}
+
+#endif
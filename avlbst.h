@@ -36,6 +36,8 @@ public:
     virtual AVLNode<Key, Value>* getParent() const override;
     virtual AVLNode<Key, Value>* getLeft() const override;
     virtual AVLNode<Key, Value>* getRight() const override;
+    virtual size_t nodeSize() const override;
+    virtual Node<Key, Value>* copyTo(void* where) const override;
 
 protected:
     int8_t balance_;    // effectively a signed char
@@ -121,6 +123,20 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
     return static_cast<AVLNode<Key, Value>*>(this->right_);
 }
 
+/**
+* Overridden so compact() copies the whole AVLNode.
+*/
+template<class Key, class Value>
+size_t AVLNode<Key, Value>::nodeSize() const
+{
+    return sizeof(AVLNode<Key, Value>);
+}
+
+template<class Key, class Value>
+Node<Key, Value>* AVLNode<Key, Value>::copyTo(void* where) const
+{
+    return new (where) AVLNode<Key, Value>(*this);
+}
 
 /*
   -----------------------------------------------
@@ -133,14 +149,49 @@ template <class Key, class Value>
 class AVLTree : public BinarySearchTree<Key, Value>
 {
 public:
+    typedef typename BinarySearchTree<Key, Value>::iterator iterator;
+    typedef NodeHandle<Key, Value, AVLNode<Key, Value> > node_handle;
+
     virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
+    virtual iterator insert (iterator hint, const std::pair<const Key, Value> &new_item);
+    std::pair<iterator, bool> insert (node_handle&& nh);
+    node_handle extract(const Key& key);
     virtual void remove(const Key& key);  // TODO
+    virtual void rebalance();
+    void swap(AVLTree& other);
 protected:
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
+    virtual Node<Key, Value>* detach(Node<Key, Value>* n);
+    virtual std::pair<iterator, bool> adopt(Node<Key, Value>* n);
+    virtual const std::type_info& nodeType() const;
+    virtual void exportFields(std::ostream& os, Node<Key, Value>* node, bool json) const;
+    virtual AVLNode<Key, Value>* makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual void link(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* node, bool left);
+    virtual void refresh(AVLNode<Key, Value>* node);
+    virtual void assign(AVLNode<Key, Value>* node, const Value& value);
 
     // Add helper functions here
     AVLNode<Key, Value>* rotateLeft(AVLNode<Key, Value>* node);
     AVLNode<Key, Value>* rotateRight(AVLNode<Key, Value>* node);
+    void insertFix(AVLNode<Key, Value>* node);
+    virtual Node<Key, Value>* cutRange(const Key& lo, const Key* hi);
+
+    // A subtree together with its height, for the split and join below.
+    struct Subtree
+    {
+        AVLNode<Key, Value>* root;
+        int height;
+    };
+    static int treeHeight(AVLNode<Key, Value>* node);
+    static Subtree leftOf(const Subtree& t);
+    static Subtree rightOf(const Subtree& t);
+    Subtree node(const Subtree& l, AVLNode<Key, Value>* k, const Subtree& r);
+    Subtree join(const Subtree& l, AVLNode<Key, Value>* k, const Subtree& r);
+    Subtree joinRight(const Subtree& l, AVLNode<Key, Value>* k, const Subtree& r);
+    Subtree joinLeft(const Subtree& l, AVLNode<Key, Value>* k, const Subtree& r);
+    Subtree join2(const Subtree& l, const Subtree& r);
+    Subtree removeMin(const Subtree& t, AVLNode<Key, Value>*& min);
+    void split(const Subtree& t, const Key& key, Subtree& less, Subtree& rest);
 
 };
 
@@ -149,6 +200,7 @@ template <class Key, class Value>
 AVLNode<Key, Value>* AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* node) {
     AVLNode<Key, Value>* leftChild = node->getLeft();
     if (!leftChild) return node;
+    this->rotations_++;
     
     node->setLeft(leftChild->getRight());
     if (leftChild->getRight() != nullptr)
@@ -170,6 +222,8 @@ AVLNode<Key, Value>* AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* node)
     
     node->setBalance(node->getBalance() - 1 - std::max(0, static_cast<int>(leftChild->getBalance())));
     leftChild->setBalance(leftChild->getBalance() - 1 + std::min(0, static_cast<int>(node->getBalance())));
+    refresh(node);
+    refresh(leftChild);
     
     return leftChild;
 }
@@ -178,6 +232,7 @@ template <class Key, class Value>
 AVLNode<Key, Value>* AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* node) {
     AVLNode<Key, Value>* rightChild = node->getRight();
     if (!rightChild) return node;
+    this->rotations_++;
     
     node->setRight(rightChild->getLeft());
     if (rightChild->getLeft() != nullptr)
@@ -199,87 +254,207 @@ AVLNode<Key, Value>* AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* node)
     
     node->setBalance(node->getBalance() + 1 - std::min(0, static_cast<int>(rightChild->getBalance())));
     rightChild->setBalance(rightChild->getBalance() + 1 + std::max(0, static_cast<int>(node->getBalance())));
+    refresh(node);
+    refresh(rightChild);
     
     return rightChild;
 }
 
+/**
+* Inserts new_item. The rebalancing walks back up through the parent
+* pointers, so the only allocation is the new node itself.
+*/
 template <class Key, class Value>
 void AVLTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item) {
+    BST_TIMED(insertLatency);
     if (this->root_ == nullptr) {
-        this->root_ = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr);
+        link(nullptr, makeNode(new_item.first, new_item.second, nullptr), false);
         return;
     }
     
-    AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->root_);
-    AVLNode<Key, Value>* parent = nullptr;
-    bool wentLeft = false;
-    std::vector<std::pair<AVLNode<Key, Value>*, bool>> path;
-    
-    while (current != nullptr) {
-        parent = current;
-        if (new_item.first < current->getKey()) {
-            current = current->getLeft();
-            wentLeft = true;
-        } else if (new_item.first > current->getKey()) {
-            current = current->getRight();
-            wentLeft = false;
-        } else {
-            current->setValue(new_item.second);
-            return;
-        }
-        path.push_back({parent, wentLeft});
+    Node<Key, Value>* parentNode;
+    AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->descend(new_item.first, this->root_, parentNode));
+    if (current != nullptr) {
+        assign(current, new_item.second);
+        return;
     }
+    AVLNode<Key, Value>* parent = static_cast<AVLNode<Key, Value>*>(parentNode);
+    bool wentLeft = new_item.first < parent->getKey();
     
-    AVLNode<Key, Value>* newNode = new AVLNode<Key, Value>(new_item.first, new_item.second, parent);
-    if (wentLeft)
-        parent->setLeft(newNode);
-    else
-        parent->setRight(newNode);
+    AVLNode<Key, Value>* newNode = makeNode(new_item.first, new_item.second, parent);
+    link(parent, newNode, wentLeft);
     
-    for (int i = static_cast<int>(path.size()) - 1; i >= 0; i--) {
-        AVLNode<Key, Value>* node = path[i].first;
-        bool childWentLeft = path[i].second;
-        
-        if (childWentLeft)
-            node->updateBalance(1);
+    insertFix(newNode);
+}
+
+/**
+* Inserts new_item, starting the search for its position at hint (see
+* BinarySearchTree::fingerStart). Returns an iterator to the item.
+*/
+template <class Key, class Value>
+typename AVLTree<Key, Value>::iterator
+AVLTree<Key, Value>::insert(iterator hint, const std::pair<const Key, Value>& new_item) {
+    BST_TIMED(insertLatency);
+    if (this->root_ == nullptr) {
+        link(nullptr, makeNode(new_item.first, new_item.second, nullptr), false);
+        return this->iteratorAt(this->root_);
+    }
+
+    Node<Key, Value>* parentNode;
+    AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(
+        this->descend(new_item.first, this->fingerStart(hint, new_item.first), parentNode));
+    if (current != nullptr) {
+        assign(current, new_item.second);
+        return this->iteratorAt(current);
+    }
+    AVLNode<Key, Value>* parent = static_cast<AVLNode<Key, Value>*>(parentNode);
+    bool wentLeft = new_item.first < parent->getKey();
+
+    AVLNode<Key, Value>* newNode = makeNode(new_item.first, new_item.second, parent);
+    link(parent, newNode, wentLeft);
+
+    insertFix(newNode);
+    return this->iteratorAt(newNode);
+}
+
+/**
+* Allocates a node for a new item. Trees that need a richer node type
+* override this.
+*/
+template <class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) {
+    return this->template createNode<AVLNode<Key, Value> >(key, value, parent);
+}
+
+/**
+* Links a new leaf below parent (as the root if parent is null), before
+* the balances are fixed. Every insert path goes through here, so
+* derived trees can hook in to maintain extra links.
+*/
+template <class Key, class Value>
+void AVLTree<Key, Value>::link(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* node, bool left) {
+    node->setParent(parent);
+    if (parent == nullptr)
+        this->root_ = node;
+    else if (left)
+        parent->setLeft(node);
+    else
+        parent->setRight(node);
+}
+
+/**
+* Recomputes whatever a derived tree keeps about the subtree under node
+* from node's item and its children. Rotations and joins call it for
+* every node they give new children, bottom-up. Nothing to do here.
+*/
+template <class Key, class Value>
+void AVLTree<Key, Value>::refresh(AVLNode<Key, Value>* node) {
+}
+
+/**
+* Overwrites the value of an item already in the tree.
+*/
+template <class Key, class Value>
+void AVLTree<Key, Value>::assign(AVLNode<Key, Value>* node, const Value& value) {
+    node->setValue(value);
+}
+
+/**
+* Walks up the parent pointers from a freshly linked leaf, updating
+* balances until a subtree's height stops changing or one rotation
+* (single or double) restores the balance.
+*/
+template <class Key, class Value>
+void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* node) {
+    AVLNode<Key, Value>* parent = node->getParent();
+
+    while (parent != nullptr) {
+        if (parent->getLeft() == node)
+            parent->updateBalance(1);
         else
-            node->updateBalance(-1);
-        
-        if (node->getBalance() == 0) {
+            parent->updateBalance(-1);
+
+        if (parent->getBalance() == 0) {
             break;
         }
-        else if (node->getBalance() == 2) {
-            AVLNode<Key, Value>* leftChild = node->getLeft();
-            if (leftChild->getBalance() == -1) {
-                rotateLeft(leftChild);
+        else if (parent->getBalance() == 2) {
+            if (parent->getLeft()->getBalance() == -1) {
+                rotateLeft(parent->getLeft());
             }
-            rotateRight(node);
+            rotateRight(parent);
             break;
         }
-        else if (node->getBalance() == -2) {
-            AVLNode<Key, Value>* rightChild = node->getRight();
-            if (rightChild->getBalance() == 1) {
-                rotateRight(rightChild);
+        else if (parent->getBalance() == -2) {
+            if (parent->getRight()->getBalance() == 1) {
+                rotateRight(parent->getRight());
             }
-            rotateLeft(node);
+            rotateLeft(parent);
             break;
         }
+        node = parent;
+        parent = node->getParent();
     }
 }
 
+/**
+* Links the node owned by nh into the tree and rebalances. If the key is
+* already present nothing changes and nh keeps its node.
+*/
+template <class Key, class Value>
+std::pair<typename AVLTree<Key, Value>::iterator, bool>
+AVLTree<Key, Value>::insert(node_handle&& nh) {
+    return this->insertHandle(nh);
+}
+
+template <class Key, class Value>
+typename AVLTree<Key, Value>::node_handle
+AVLTree<Key, Value>::extract(const Key& key) {
+    return this->template extractHandle<node_handle>(key);
+}
+
+/**
+* Links a node from a handle with link() and rebalances, like insert().
+*/
+template <class Key, class Value>
+std::pair<typename AVLTree<Key, Value>::iterator, bool>
+AVLTree<Key, Value>::adopt(Node<Key, Value>* n) {
+    AVLNode<Key, Value>* newNode = static_cast<AVLNode<Key, Value>*>(n);
+    Node<Key, Value>* parentNode;
+    Node<Key, Value>* existing = this->descend(newNode->getKey(), this->root_, parentNode);
+    if (existing != nullptr)
+        return std::make_pair(this->iteratorAt(existing), false);
+    AVLNode<Key, Value>* parent = static_cast<AVLNode<Key, Value>*>(parentNode);
+    bool wentLeft = parent != nullptr && newNode->getKey() < parent->getKey();
+
+    this->indexNode(newNode);
+    this->size_++;
+    link(parent, newNode, wentLeft);
+    if (parent != nullptr)
+        insertFix(newNode);
+    return std::make_pair(this->iteratorAt(newNode), true);
+}
+
+template <class Key, class Value>
+const std::type_info& AVLTree<Key, Value>::nodeType() const {
+    return typeid(AVLNode<Key, Value>);
+}
+
 template <class Key, class Value>
 void AVLTree<Key, Value>::remove(const Key& key) {
-    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->root_);
-    
-    while (node != nullptr && node->getKey() != key) {
-        if (key < node->getKey())
-            node = node->getLeft();
-        else
-            node = node->getRight();
-    }
+    BST_TIMED(removeLatency);
+    Node<Key, Value>* node = this->internalFind(key);
     
-    if (node == nullptr)
-        return;
+    if (node != nullptr)
+        this->freeNode(detach(node));
+}
+
+/**
+* Unlinks n from the tree and rebalances, possibly all the way up to
+* the root. Returns n with its links and balance cleared.
+*/
+template <class Key, class Value>
+Node<Key, Value>* AVLTree<Key, Value>::detach(Node<Key, Value>* n) {
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(n);
     
     if (node->getLeft() != nullptr && node->getRight() != nullptr) {
         AVLNode<Key, Value>* pred = node->getLeft();
@@ -317,7 +492,10 @@ void AVLTree<Key, Value>::remove(const Key& key) {
     AVLNode<Key, Value>* current = parent;
     int8_t heightDiff = isLeftChild ? -1 : 1;
     
-    delete node;
+    node->setParent(nullptr);
+    node->setLeft(nullptr);
+    node->setRight(nullptr);
+    node->setBalance(0);
     
     while (current != nullptr) {
         current->updateBalance(heightDiff);
@@ -351,7 +529,204 @@ void AVLTree<Key, Value>::remove(const Key& key) {
             break;
         }
     }
+    return node;
+}
+/**
+* Cuts out the range with split and join: the tree is split at lo and
+* hi, and the parts below and above the range are joined back together.
+* Each split and join only rebuilds along one root-to-leaf path, so this
+* is O(log n) however large the range is.
+*/
+template <class Key, class Value>
+Node<Key, Value>* AVLTree<Key, Value>::cutRange(const Key& lo, const Key* hi) {
+    AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this->root_);
+    Subtree whole = { root, treeHeight(root) };
+    Subtree less, rest, range, greater = { nullptr, 0 };
+    split(whole, lo, less, rest);
+    if (hi != nullptr)
+        split(rest, *hi, range, greater);
+    else
+        range = rest;
+    Subtree joined = join2(less, greater);
+    this->root_ = joined.root;
+    if (joined.root != nullptr)
+        joined.root->setParent(nullptr);
+    range.root->setParent(nullptr);
+    return range.root;
+}
+
+/**
+* The height of the subtree under node, following the taller child down.
+*/
+template <class Key, class Value>
+int AVLTree<Key, Value>::treeHeight(AVLNode<Key, Value>* node) {
+    int height = 0;
+    while (node != nullptr) {
+        height++;
+        node = node->getBalance() >= 0 ? node->getLeft() : node->getRight();
+    }
+    return height;
+}
+
+/**
+* The children of t with their heights, which follow from t's height and
+* balance. Both must be taken before t's root is relinked.
+*/
+template <class Key, class Value>
+typename AVLTree<Key, Value>::Subtree AVLTree<Key, Value>::leftOf(const Subtree& t) {
+    Subtree l = { t.root->getLeft(), t.height - (t.root->getBalance() >= 0 ? 1 : 2) };
+    return l;
+}
+
+template <class Key, class Value>
+typename AVLTree<Key, Value>::Subtree AVLTree<Key, Value>::rightOf(const Subtree& t) {
+    Subtree r = { t.root->getRight(), t.height - (t.root->getBalance() <= 0 ? 1 : 2) };
+    return r;
+}
+
+/**
+* Makes k the root over l and r, whose heights differ by at most 2; the
+* callers only leave a difference of 2 for a rotation to fix at once.
+*/
+template <class Key, class Value>
+typename AVLTree<Key, Value>::Subtree
+AVLTree<Key, Value>::node(const Subtree& l, AVLNode<Key, Value>* k, const Subtree& r) {
+    k->setLeft(l.root);
+    k->setRight(r.root);
+    if (l.root != nullptr)
+        l.root->setParent(k);
+    if (r.root != nullptr)
+        r.root->setParent(k);
+    k->setParent(nullptr);
+    k->setBalance(static_cast<int8_t>(l.height - r.height));
+    refresh(k);
+    Subtree t = { k, 1 + std::max(l.height, r.height) };
+    return t;
+}
+
+/**
+* Joins l, k and r, where every key in l is less than k and every key in
+* r greater, into one AVL tree. O(difference in height).
+*/
+template <class Key, class Value>
+typename AVLTree<Key, Value>::Subtree
+AVLTree<Key, Value>::join(const Subtree& l, AVLNode<Key, Value>* k, const Subtree& r) {
+    if (l.height > r.height + 1)
+        return joinRight(l, k, r);
+    if (r.height > l.height + 1)
+        return joinLeft(l, k, r);
+    return node(l, k, r);
+}
+
+/**
+* Walks down the right spine of the taller l to a subtree about as high
+* as r, hangs k there and rotates on the way back up where needed.
+*/
+template <class Key, class Value>
+typename AVLTree<Key, Value>::Subtree
+AVLTree<Key, Value>::joinRight(const Subtree& l, AVLNode<Key, Value>* k, const Subtree& r) {
+    Subtree ll = leftOf(l);
+    Subtree c = rightOf(l);
+    if (c.height <= r.height + 1) {
+        if (std::max(c.height, r.height) <= ll.height) {
+            Subtree t = node(c, k, r);
+            return node(ll, l.root, t);
+        }
+        // k's subtree would be two higher than ll: double rotation
+        Subtree c1 = leftOf(c);
+        Subtree c2 = rightOf(c);
+        Subtree a = node(ll, l.root, c1);
+        Subtree b = node(c2, k, r);
+        return node(a, c.root, b);
+    }
+    Subtree t = joinRight(c, k, r);
+    if (t.height <= ll.height + 1)
+        return node(ll, l.root, t);
+    // single rotation to the left
+    Subtree t1 = leftOf(t);
+    Subtree t2 = rightOf(t);
+    Subtree a = node(ll, l.root, t1);
+    return node(a, t.root, t2);
+}
+
+template <class Key, class Value>
+typename AVLTree<Key, Value>::Subtree
+AVLTree<Key, Value>::joinLeft(const Subtree& l, AVLNode<Key, Value>* k, const Subtree& r) {
+    Subtree rr = rightOf(r);
+    Subtree c = leftOf(r);
+    if (c.height <= l.height + 1) {
+        if (std::max(c.height, l.height) <= rr.height) {
+            Subtree t = node(l, k, c);
+            return node(t, r.root, rr);
+        }
+        Subtree c1 = leftOf(c);
+        Subtree c2 = rightOf(c);
+        Subtree a = node(l, k, c1);
+        Subtree b = node(c2, r.root, rr);
+        return node(a, c.root, b);
+    }
+    Subtree t = joinLeft(l, k, c);
+    if (t.height <= rr.height + 1)
+        return node(t, r.root, rr);
+    Subtree t1 = leftOf(t);
+    Subtree t2 = rightOf(t);
+    Subtree b = node(t2, r.root, rr);
+    return node(t1, t.root, b);
+}
+
+/**
+* Joins l and r, every key in l less than every key in r, by taking the
+* smallest node of r as the middle.
+*/
+template <class Key, class Value>
+typename AVLTree<Key, Value>::Subtree
+AVLTree<Key, Value>::join2(const Subtree& l, const Subtree& r) {
+    if (r.root == nullptr)
+        return l;
+    if (l.root == nullptr)
+        return r;
+    AVLNode<Key, Value>* min;
+    Subtree rest = removeMin(r, min);
+    return join(l, min, rest);
+}
+
+template <class Key, class Value>
+typename AVLTree<Key, Value>::Subtree
+AVLTree<Key, Value>::removeMin(const Subtree& t, AVLNode<Key, Value>*& min) {
+    Subtree r = rightOf(t);
+    if (t.root->getLeft() == nullptr) {
+        min = t.root;
+        return r;
+    }
+    Subtree rest = removeMin(leftOf(t), min);
+    return join(rest, t.root, r);
+}
+
+/**
+* Splits t into the keys less than key and the rest. Recurses once per
+* level; each level joins a node and a subtree it owned onto one side.
+* The roots returned may still point at their old parents.
+*/
+template <class Key, class Value>
+void AVLTree<Key, Value>::split(const Subtree& t, const Key& key, Subtree& less, Subtree& rest) {
+    if (t.root == nullptr) {
+        less = rest = t;
+        return;
+    }
+    Subtree l = leftOf(t);
+    Subtree r = rightOf(t);
+    Subtree a, b;
+    if (t.root->getKey() < key) {
+        split(r, key, a, b);
+        less = join(l, t.root, a);
+        rest = b;
+    } else {
+        split(l, key, a, b);
+        less = a;
+        rest = join(b, t.root, r);
+    }
 }
+
 template<class Key, class Value>
 void AVLTree<Key, Value>::nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2)
 {
@@ -365,4 +740,38 @@ void AVLTree<Key, Value>::nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>*
     n2->setBalance(tempB);
 }
 
+/**
+* Adds each node's balance factor to the exports.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::exportFields(std::ostream& os, Node<Key, Value>* node, bool json) const {
+    int balance = static_cast<AVLNode<Key, Value>*>(node)->getBalance();
+    if (json)
+        os << ",\"balance\":" << balance;
+    else
+        os << "\\nbalance " << balance;
+}
+
+/**
+* The tree is always balanced, and rebuilding it would invalidate
+* the stored balance factors, so this does nothing.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::rebalance() {
+}
+
+/**
+* Exchanges the contents of two AVLTrees in O(1); the balance factors
+* live in the nodes, so they go along.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::swap(AVLTree& other) {
+    this->swapTrees(other);
+}
+
+template<class Key, class Value>
+void swap(AVLTree<Key, Value>& a, AVLTree<Key, Value>& b) {
+    a.swap(b);
+}
+
 #endif
\ No newline at end of file
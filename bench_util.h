@@ -0,0 +1,59 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <iostream>
+#include <map>
+#include <chrono>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// Helpers shared by the benchmark and measurement tools.
+
+inline uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs one measurement in a child process so it starts from a fresh heap;
+// otherwise a tree built after another one is freed gets its nodes from
+// the scattered free lists and looks slower than it is. Returns false if
+// the child failed.
+template<typename Fn>
+bool isolated(Fn fn)
+{
+    std::cout.flush();
+    pid_t pid = fork();
+    if(pid == 0) {
+        bool ok = fn();
+        std::cout.flush();
+        _exit(ok ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+inline uint64_t peakRssKb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Uniform operations over the engines. The trees and std::map differ in
+// how they overwrite and erase, so each gets its own overloads.
+template<typename Tree>
+void put(Tree& t, uint64_t k, uint64_t v) { t.insert(std::make_pair(k, v)); }
+inline void put(std::map<uint64_t, uint64_t>& t, uint64_t k, uint64_t v) { t[k] = v; }
+
+template<typename Tree>
+void erase(Tree& t, uint64_t k) { t.remove(k); }
+inline void erase(std::map<uint64_t, uint64_t>& t, uint64_t k) { t.erase(k); }
+
+template<typename Tree>
+bool contains(const Tree& t, uint64_t k) { return t.find(k) != t.end(); }
+
+#endif
@@ -0,0 +1,878 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <map>
+#include <algorithm>
+#include <sstream>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbbst.h"
+#include "threadedavl.h"
+#include "augmentedavl.h"
+#include "intervaltree.h"
+#include "bst_string_key.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Benchmarks for the search tree engines. The suite mode covers every
+// engine and workload and prints CSV or JSON; the other modes focus on
+// one feature and print a table. Sizes are taken from the command line
+// so the larger runs can be done on a machine with enough memory.
+
+static void printRow(const string& engine, uint64_t n, uint64_t ops, uint64_t ns, double rotations)
+{
+    cout << left << setw(14) << engine << right
+         << setw(12) << n
+         << setw(12) << ops
+         << setw(12) << fixed << setprecision(1) << (double)ns / ops
+         << setw(14) << setprecision(3) << rotations << endl;
+}
+
+// Delete-heavy churn: the tree is filled with n random keys, then every
+// op removes a random present key and inserts a fresh one, so the size
+// stays at n.
+template<typename Tree>
+void churn(const string& engine, uint64_t n, uint64_t ops)
+{
+    Tree tree;
+    mt19937_64 rng(104);
+    vector<uint64_t> keys;
+    keys.reserve(n);
+    while(keys.size() < n) {
+        uint64_t k = rng();
+        if(tree.find(k) != tree.end()) continue;
+        tree.insert(std::make_pair(k, k));
+        keys.push_back(k);
+    }
+
+    size_t rotationsBefore = tree.rotations();
+    uint64_t start = nowNs();
+    for(uint64_t i = 0; i < ops; i++) {
+        size_t victim = rng() % keys.size();
+        tree.remove(keys[victim]);
+        uint64_t k = rng();
+        tree.insert(std::make_pair(k, k));
+        keys[victim] = k;
+    }
+    uint64_t elapsed = nowNs() - start;
+
+    // each op is one remove plus one insert
+    printRow(engine, n, 2 * ops, elapsed, (double)(tree.rotations() - rotationsBefore) / (2 * ops));
+}
+
+// Key streams for the hinted insert benchmark. "nearly" is sorted
+// timestamps with up to +-jitter of noise.
+static vector<uint64_t> makeStream(const string& kind, uint64_t n)
+{
+    mt19937_64 rng(7);
+    vector<uint64_t> keys(n);
+    const uint64_t jitter = 64;
+    for(uint64_t i = 0; i < n; i++) {
+        if(kind == "sorted") keys[i] = i * 16;
+        else if(kind == "nearly") keys[i] = i * 16 + rng() % (2 * jitter);
+        else keys[i] = rng();
+    }
+    return keys;
+}
+
+// Inserts the whole stream, either plainly or with the previous insert's
+// position as the hint.
+template<typename Tree>
+void hintedInsert(const string& stream, uint64_t n, bool hinted)
+{
+    vector<uint64_t> keys = makeStream(stream, n);
+    {
+        Tree tree;
+        typename Tree::iterator hint = tree.end();
+        uint64_t start = nowNs();
+        if(hinted) {
+            for(uint64_t i = 0; i < n; i++) hint = tree.insert(hint, std::make_pair(keys[i], i));
+        }
+        else {
+            for(uint64_t i = 0; i < n; i++) tree.insert(std::make_pair(keys[i], i));
+        }
+        uint64_t elapsed = nowNs() - start;
+        cout << left << setw(10) << stream << setw(10) << (hinted ? "hinted" : "plain") << right
+             << setw(12) << n << setw(12) << fixed << setprecision(1) << (double)elapsed / n << endl;
+    }
+}
+
+// Random lookups of present keys, in batches of the given size, done
+// either one find() at a time or with findBatch().
+template<typename Tree>
+void batchFind(uint64_t n, uint64_t batch, bool batched)
+{
+    vector<uint64_t> keys = makeStream("random", n);
+    Tree tree;
+    for(uint64_t i = 0; i < n; i++) tree.insert(std::make_pair(keys[i], i));
+
+    const uint64_t ops = 2000000;
+    mt19937_64 rng(11);
+    vector<uint64_t> probe(batch);
+    vector<typename Tree::iterator> found;
+    uint64_t checksum = 0, elapsed = 0;
+    for(uint64_t done = 0; done < ops; done += batch) {
+        for(uint64_t j = 0; j < batch; j++) probe[j] = keys[rng() % n];
+        uint64_t start = nowNs();
+        if(batched) {
+            tree.findBatch(probe, found);
+            for(uint64_t j = 0; j < batch; j++) checksum += found[j]->second;
+        }
+        else {
+            for(uint64_t j = 0; j < batch; j++) checksum += tree.find(probe[j])->second;
+        }
+        elapsed += nowNs() - start;
+    }
+    uint64_t timed = (ops + batch - 1) / batch * batch;
+    cout << left << setw(10) << (batched ? "findBatch" : "find") << right << setw(12) << n
+         << setw(8) << batch << setw(12) << fixed << setprecision(1) << (double)elapsed / timed
+         << setw(14) << setprecision(0) << timed * 1e9 / elapsed
+         << "  (checksum " << checksum << ")" << endl;
+}
+
+// Sums the values in one full in-order pass.
+template<typename Tree>
+uint64_t scanForward(const Tree& tree)
+{
+    uint64_t sum = 0;
+    for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) sum += it->second;
+    return sum;
+}
+
+// Only the threaded tree can step backward.
+template<typename Key, typename Value>
+uint64_t scanBackward(const ThreadedAVLTree<Key, Value>& tree)
+{
+    uint64_t sum = 0;
+    for(typename ThreadedAVLTree<Key, Value>::iterator it = tree.last(); it != tree.end(); --it) sum += it->second;
+    return sum;
+}
+
+// Full scans of a tree of n random keys with the given scan function;
+// best of several passes.
+template<typename Tree, typename Scan>
+void fullScan(const string& engine, const string& step, uint64_t n, Scan scan)
+{
+    vector<uint64_t> keys = makeStream("random", n);
+    Tree tree;
+    for(uint64_t i = 0; i < n; i++) tree.insert(std::make_pair(keys[i], i));
+
+    const int passes = 5;
+    uint64_t best = ~0ULL, checksum = 0;
+    for(int pass = 0; pass < passes; pass++) {
+        uint64_t start = nowNs();
+        checksum += scan(tree);
+        uint64_t elapsed = nowNs() - start;
+        if(elapsed < best) best = elapsed;
+    }
+    cout << left << setw(18) << engine << setw(6) << step << right << setw(12) << n
+         << setw(12) << fixed << setprecision(2) << (double)best / n
+         << setw(14) << setprecision(0) << n * 1e9 / best
+         << "  (checksum " << checksum << ")" << endl;
+}
+
+// Random hits and a full scan, timed; used before and after compact().
+template<typename Tree>
+void lookupsAndScan(const string& when, const Tree& tree, const vector<uint64_t>& keys)
+{
+    const uint64_t ops = 2000000;
+    mt19937_64 rng(5);
+    uint64_t checksum = 0;
+    uint64_t start = nowNs();
+    for(uint64_t i = 0; i < ops; i++) checksum += contains(tree, keys[rng() % keys.size()]);
+    uint64_t findNs = nowNs() - start;
+    start = nowNs();
+    checksum += scanForward(tree);
+    uint64_t scanNs = nowNs() - start;
+    cout << left << setw(16) << when << right << setw(12) << fixed << setprecision(1) << (double)findNs / ops
+         << setw(12) << setprecision(2) << (double)scanNs / tree.size()
+         << "  (checksum " << checksum << ")" << endl;
+}
+
+// Fills a tree with n random keys, churns it with as many remove/insert
+// pairs, then compacts it in steps of the given size.
+template<typename Tree>
+void compactAfterChurn(uint64_t n, uint64_t step)
+{
+    mt19937_64 rng(3);
+    vector<uint64_t> keys(n);
+    Tree tree;
+    for(uint64_t i = 0; i < n; i++) {
+        keys[i] = rng();
+        tree.insert(std::make_pair(keys[i], i));
+    }
+    for(uint64_t i = 0; i < 4 * n; i++) {
+        size_t victim = rng() % n;
+        tree.remove(keys[victim]);
+        keys[victim] = rng();
+        tree.insert(std::make_pair(keys[victim], i));
+    }
+    lookupsAndScan("after churn", tree, keys);
+
+    uint64_t calls = 0, worst = 0;
+    uint64_t start = nowNs();
+    for(bool done = false; !done; calls++) {
+        uint64_t t0 = nowNs();
+        done = tree.compact(step);
+        uint64_t ns = nowNs() - t0;
+        if(ns > worst) worst = ns;
+    }
+    uint64_t total = nowNs() - start;
+    lookupsAndScan("after compact", tree, keys);
+    cout << "compact(" << step << "): " << calls << " calls, " << fixed << setprecision(1)
+         << total / 1e6 << " ms total, longest call " << worst / 1e3 << " us" << endl;
+}
+
+// n random keys, then lookups of which the given share miss, with and
+// without a Bloom filter of the given size in front.
+template<typename Tree>
+void bloomFind(uint64_t n, double missShare, double bitsPerKey)
+{
+    vector<uint64_t> keys = makeStream("random", n);
+    Tree tree;
+    if(bitsPerKey > 0) tree.setBloomFilter(bitsPerKey);
+    for(uint64_t i = 0; i < n; i++) tree.insert(std::make_pair(keys[i], i));
+
+    const uint64_t ops = 2000000;
+    mt19937_64 rng(9);
+    vector<uint64_t> probe(ops);
+    for(uint64_t i = 0; i < ops; i++) {
+        // random 64-bit keys are almost never in the tree
+        probe[i] = (double)(rng() % 1000) < missShare * 1000 ? rng() : keys[rng() % n];
+    }
+    uint64_t hits = 0;
+    uint64_t start = nowNs();
+    for(uint64_t i = 0; i < ops; i++) hits += contains(tree, probe[i]);
+    uint64_t elapsed = nowNs() - start;
+    cout << left << setw(10) << (bitsPerKey > 0 ? "bloom" : "none") << right << setw(12) << n
+         << setw(10) << fixed << setprecision(0) << missShare * 100 << "%"
+         << setw(12) << setprecision(1) << (double)elapsed / ops
+         << setw(14) << tree.bloomFilterBytes() / 1024 << " KB"
+         << "  (hits " << hits << ")" << endl;
+}
+
+// Windowed expiry: the tree holds the last n timestamps, and each step
+// appends batch newer ones and expires the batch oldest, either with one
+// erase(lo, hi) or with a remove() per key, until the window has turned
+// over once. Only the expiry is timed.
+template<typename Tree>
+void expireWindow(const string& engine, uint64_t n, uint64_t batch, bool ranged)
+{
+    Tree tree;
+    for(uint64_t t = 0; t < n; t++) tree.insert(std::make_pair(t, t));
+    uint64_t elapsed = 0;
+    uint64_t expired = 0;
+    for(uint64_t oldest = 0; oldest < n; oldest += batch) {
+        for(uint64_t t = n + oldest; t < n + oldest + batch; t++) tree.insert(std::make_pair(t, t));
+        uint64_t start = nowNs();
+        if(ranged) {
+            expired += tree.erase(oldest, oldest + batch);
+        }
+        else {
+            for(uint64_t t = oldest; t < oldest + batch; t++) tree.remove(t);
+            expired += batch;
+        }
+        elapsed += nowNs() - start;
+    }
+    cout << left << setw(14) << engine << setw(10) << (ranged ? "erase" : "remove") << right
+         << setw(12) << n << setw(10) << batch
+         << setw(12) << fixed << setprecision(1) << (double)elapsed / expired
+         << setw(12) << setprecision(1) << (double)elapsed / 1e3 * batch / expired << endl;
+}
+
+// Sums of values over random key ranges covering the given share of n
+// keys: by walking the range with an iterator, and with aggregate().
+void rangeSums(uint64_t n, double share)
+{
+    AugmentedAVLTree<uint64_t, uint64_t, SumAggregate<uint64_t> > tree;
+    vector<uint64_t> keys(n);
+    for(uint64_t i = 0; i < n; i++) keys[i] = 2 * i;
+    mt19937_64 rng(11);
+    shuffle(keys.begin(), keys.end(), rng);
+    for(uint64_t i = 0; i < n; i++) tree.insert(std::make_pair(keys[i], i));
+    uint64_t width = (uint64_t)(share * n) * 2;    // the keys are even
+    const uint64_t queries = share < 0.001 ? 10000 : 200;
+    vector<uint64_t> lo(queries);
+    for(uint64_t q = 0; q < queries; q++) lo[q] = keys[rng() % n];     // the scans start with find()
+
+    uint64_t scanned = 0, aggregated = 0;
+    uint64_t start = nowNs();
+    for(uint64_t q = 0; q < queries; q++) {
+        for(AugmentedAVLTree<uint64_t, uint64_t, SumAggregate<uint64_t> >::iterator it = tree.find(lo[q]);
+            it != tree.end() && it->first < lo[q] + width; ++it) {
+            scanned += it->second;
+        }
+    }
+    uint64_t scan = nowNs() - start;
+    start = nowNs();
+    for(uint64_t q = 0; q < queries; q++) aggregated += tree.aggregate(lo[q], lo[q] + width);
+    uint64_t agg = nowNs() - start;
+    cout << setw(12) << n << setw(9) << fixed << setprecision(1) << share * 100 << "%"
+         << setw(14) << setprecision(1) << (double)scan / queries / 1e3
+         << setw(14) << setprecision(2) << (double)agg / queries / 1e3
+         << (scanned == aggregated ? "" : "  MISMATCH") << endl;
+}
+
+// n time intervals of mostly short lengths; stabbing queries answered by
+// scanning every interval and by IntervalTree::stab().
+void stabIntervals(uint64_t n)
+{
+    IntervalTree<uint64_t, uint64_t> tree;
+    mt19937_64 rng(12);
+    const uint64_t span = 1000 * n;
+    for(uint64_t i = 0; i < n; i++) {
+        uint64_t start = rng() % span;
+        uint64_t length = rng() % 16 == 0 ? rng() % 100000 : rng() % 2000;
+        tree.insert(std::make_pair(Interval<uint64_t>(start, start + length + 1), i));
+    }
+    const uint64_t queries = n >= 1000000 ? 20 : 200;
+    vector<uint64_t> points(queries);
+    for(uint64_t q = 0; q < queries; q++) points[q] = rng() % span;
+
+    uint64_t scanned = 0, stabbed = 0;
+    uint64_t start = nowNs();
+    for(uint64_t q = 0; q < queries; q++) {
+        for(IntervalTree<uint64_t, uint64_t>::iterator it = tree.begin(); it != tree.end(); ++it) {
+            scanned += it->first.start <= points[q] && points[q] < it->first.end;
+        }
+    }
+    uint64_t scan = nowNs() - start;
+    vector<IntervalTree<uint64_t, uint64_t>::iterator> found;
+    start = nowNs();
+    for(uint64_t q = 0; q < queries; q++) {
+        found.clear();
+        tree.stab(points[q], found);
+        stabbed += found.size();
+    }
+    uint64_t stab = nowNs() - start;
+    cout << setw(12) << n << setw(12) << fixed << setprecision(1) << (double)stabbed / queries
+         << setw(14) << (double)scan / queries / 1e3
+         << setw(14) << setprecision(2) << (double)stab / queries / 1e3
+         << (scanned == stabbed ? "" : "  MISMATCH") << endl;
+}
+
+// Copies a tree of n random keys with the copy constructor and by
+// inserting its items into an empty tree, then moves it.
+template<typename Tree>
+void copyTree(const string& engine, uint64_t n)
+{
+    vector<uint64_t> keys = makeStream("random", n);
+    Tree tree;
+    for(uint64_t i = 0; i < n; i++) tree.insert(std::make_pair(keys[i], i));
+
+    uint64_t start = nowNs();
+    Tree copy(tree);
+    uint64_t copied = nowNs() - start;
+    start = nowNs();
+    Tree rebuilt;
+    for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) rebuilt.insert(*it);
+    uint64_t inserted = nowNs() - start;
+    start = nowNs();
+    Tree moved(std::move(copy));
+    uint64_t move = nowNs() - start;
+    cout << left << setw(14) << engine << right << setw(12) << n
+         << setw(14) << fixed << setprecision(1) << (double)copied / n
+         << setw(14) << (double)inserted / n
+         << setw(12) << move << (moved.size() == rebuilt.size() ? "" : "  MISMATCH") << endl;
+}
+
+// A uint64_t the trees cannot tell is integral, so it takes the generic
+// descent; used to compare against the branchless one.
+struct BoxedKey
+{
+    BoxedKey(uint64_t v) : v(v) { }
+    bool operator<(const BoxedKey& other) const { return v < other.v; }
+    bool operator==(const BoxedKey& other) const { return v == other.v; }
+    uint64_t v;
+};
+
+// printRoot() needs the key printable even though nothing here calls it
+ostream& operator<<(ostream& os, const BoxedKey& key)
+{
+    return os << key.v;
+}
+
+// n random inserts, then n random hits, with the given key type.
+template<typename Key>
+void integralDescent(const string& path, uint64_t n)
+{
+    vector<uint64_t> keys = makeStream("random", n);
+    AVLTree<Key, uint64_t> tree;
+    uint64_t start = nowNs();
+    for(uint64_t i = 0; i < n; i++) tree.insert(std::make_pair(Key(keys[i]), i));
+    uint64_t insertNs = nowNs() - start;
+
+    mt19937_64 rng(5);
+    uint64_t checksum = 0;
+    start = nowNs();
+    for(uint64_t i = 0; i < n; i++) checksum += tree.find(Key(keys[rng() % n]))->second;
+    uint64_t findNs = nowNs() - start;
+    cout << left << setw(10) << path << right << setw(12) << n << setw(12) << fixed << setprecision(1)
+         << (double)insertNs / n << setw(12) << (double)findNs / n << "  (checksum " << checksum << ")" << endl;
+}
+
+// URL-like keys with the scheme stripped, e.g. "www.qhbxze.com/...",
+// long enough to live on the heap.
+static vector<string> makeUrls(uint64_t n)
+{
+    mt19937_64 rng(36);
+    vector<string> urls(n);
+    for(uint64_t i = 0; i < n; i++) {
+        string url = "www.";
+        for(int j = 0; j < 6; j++) url += (char)('a' + rng() % 26);
+        url += ".com/";
+        for(int j = 0; j < 20; j++) url += (char)('a' + rng() % 26);
+        urls[i] = url;
+    }
+    return urls;
+}
+
+// n random inserts, then n random hits, with std::string or
+// PrefixedString keys. The probe keys are built before timing.
+template<typename Key>
+void stringKeys(const string& type, uint64_t n)
+{
+    vector<string> urls = makeUrls(n);
+    vector<Key> keys(urls.begin(), urls.end());
+    mt19937_64 rng(5);
+    vector<Key> probes;
+    for(uint64_t i = 0; i < n; i++) probes.push_back(keys[rng() % n]);
+
+    AVLTree<Key, uint64_t> tree;
+    uint64_t start = nowNs();
+    for(uint64_t i = 0; i < n; i++) tree.insert(std::make_pair(keys[i], i));
+    uint64_t insertNs = nowNs() - start;
+
+    uint64_t checksum = 0;
+    start = nowNs();
+    for(uint64_t i = 0; i < n; i++) checksum += tree.find(probes[i])->second;
+    uint64_t findNs = nowNs() - start;
+    cout << left << setw(16) << type << right << setw(12) << n << setw(12) << fixed << setprecision(1)
+         << (double)insertNs / n << setw(12) << (double)findNs / n << "  (checksum " << checksum << ")" << endl;
+}
+
+// Random inserts into an initially empty tree. Small trees are rebuilt
+// until at least 1M inserts have been timed.
+template<typename Tree>
+void insertRandom(const string& engine, uint64_t n)
+{
+    vector<uint64_t> keys = makeStream("random", n);
+    uint64_t rounds = n >= 1000000 ? 1 : 1000000 / n;
+    uint64_t elapsed = 0;
+    for(uint64_t r = 0; r < rounds; r++) {
+        Tree tree;
+        uint64_t start = nowNs();
+        for(uint64_t i = 0; i < n; i++) tree.insert(std::make_pair(keys[i], i));
+        elapsed += nowNs() - start;
+    }
+    cout << left << setw(14) << engine << right << setw(12) << n
+         << setw(12) << fixed << setprecision(1) << (double)elapsed / (n * rounds) << endl;
+}
+
+/*
+  -----------------------------------------------------------------
+  The benchmark suite: every engine x workload x key distribution x
+  size, reported as CSV or JSON for regression tracking.
+  -----------------------------------------------------------------
+*/
+
+// Zipf(theta) ranks in [0, n) using the inverse-CDF approximation of
+// Gray et al. ("Quickly generating billion-record synthetic databases"),
+// which needs O(1) memory so it also works for 100M-entry runs.
+class ZipfGenerator
+{
+public:
+    ZipfGenerator(uint64_t n, double theta) : n_(n), theta_(theta), rng_(11)
+    {
+        zetan_ = 0;
+        for(uint64_t i = 1; i <= n; i++) zetan_ += 1.0 / pow((double)i, theta);
+        double zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+        alpha_ = 1.0 / (1.0 - theta);
+        eta_ = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan_);
+    }
+
+    uint64_t next()
+    {
+        double u = uniform_real_distribution<double>(0.0, 1.0)(rng_);
+        double uz = u * zetan_;
+        if(uz < 1.0) return 0;
+        if(uz < 1.0 + pow(0.5, theta_)) return n_ > 1 ? 1 : 0;
+        uint64_t r = (uint64_t)(n_ * pow(eta_ * u - eta_ + 1.0, alpha_));
+        return r < n_ ? r : n_ - 1;
+    }
+
+private:
+    uint64_t n_;
+    double theta_, zetan_, alpha_, eta_;
+    mt19937_64 rng_;
+};
+
+// The n keys present in the tree are all even, so key | 1 is a miss.
+// "seq" keys are in increasing order, "random" keys are a random
+// permutation, and "zipf" streams repeat the popular keys of the random
+// set with Zipf(0.99) frequencies.
+struct Workload
+{
+    vector<uint64_t> present;   // distinct keys, in build order
+    vector<uint64_t> stream;    // keys the timed operations use
+};
+
+static Workload makeWorkload(const string& dist, uint64_t n)
+{
+    Workload w;
+    w.present.resize(n);
+    mt19937_64 rng(104);
+    for(uint64_t i = 0; i < n; i++) w.present[i] = 2 * i;
+    if(dist != "seq") {
+        shuffle(w.present.begin(), w.present.end(), rng);
+    }
+    if(dist == "zipf") {
+        ZipfGenerator zipf(n, 0.99);
+        w.stream.resize(n);
+        for(uint64_t i = 0; i < n; i++) w.stream[i] = w.present[zipf.next()];
+    }
+    else {
+        w.stream = w.present;
+    }
+    return w;
+}
+
+// The suite's "avl-hash" engine: an AVLTree with the hash side index on.
+struct HashedAVLTree : public AVLTree<uint64_t, uint64_t>
+{
+    HashedAVLTree() { setHashIndex(true); }
+};
+
+struct SuiteOptions
+{
+    string format;
+    vector<string> engines, workloads, dists;
+    vector<uint64_t> sizes;
+};
+
+// Times one workload and prints one record. Small sizes are repeated
+// on fresh trees until at least 1M operations have been timed.
+template<typename Tree>
+void suiteRun(const SuiteOptions& opt, const string& engine, const string& workload,
+              const string& dist, uint64_t n, bool first)
+{
+    Workload w = makeWorkload(dist, n);
+    uint64_t rounds = n >= 1000000 ? 1 : 1000000 / n;
+    uint64_t ops = n * rounds;
+    uint64_t checksum = 0;
+    uint64_t elapsed = 0;
+    mt19937_64 rng(5);
+
+    for(uint64_t r = 0; r < rounds; r++) {
+        Tree tree;
+        if(workload != "insert") {
+            for(uint64_t i = 0; i < n; i++) put(tree, w.present[i], i);
+        }
+
+        uint64_t start = nowNs();
+        if(workload == "insert") {
+            for(uint64_t i = 0; i < n; i++) put(tree, w.stream[i], i);
+        }
+        else if(workload == "find-hit") {
+            for(uint64_t i = 0; i < n; i++) checksum += contains(tree, w.stream[i]);
+        }
+        else if(workload == "find-miss") {
+            for(uint64_t i = 0; i < n; i++) checksum += contains(tree, w.stream[i] | 1);
+        }
+        else if(workload == "remove") {
+            for(uint64_t i = 0; i < n; i++) erase(tree, w.stream[i]);
+        }
+        else if(workload == "iterate") {
+            for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) checksum += it->second;
+        }
+        else if(workload == "mixed") {
+            // 50% find, 25% insert (overwrite or re-insert), 25% remove
+            for(uint64_t i = 0; i < n; i++) {
+                uint64_t k = w.stream[i];
+                switch(rng() & 3) {
+                case 0: case 1: checksum += contains(tree, k); break;
+                case 2: put(tree, k, i); break;
+                default: erase(tree, k); break;
+                }
+            }
+        }
+        elapsed += nowNs() - start;
+    }
+    if(elapsed == 0) elapsed = 1;
+
+    double nsPerOp = (double)elapsed / ops;
+    double opsPerSec = 1e9 * ops / elapsed;
+    uint64_t rss = peakRssKb();
+    if(opt.format == "json") {
+        cout << (first ? "  " : ", ")
+             << "{\"engine\": \"" << engine << "\", \"workload\": \"" << workload
+             << "\", \"keys\": \"" << dist << "\", \"n\": " << n << ", \"ops\": " << ops
+             << ", \"ns_per_op\": " << fixed << setprecision(2) << nsPerOp
+             << ", \"ops_per_sec\": " << setprecision(0) << opsPerSec
+             << ", \"peak_rss_kb\": " << rss << ", \"checksum\": " << checksum << "}" << endl;
+    }
+    else {
+        cout << engine << "," << workload << "," << dist << "," << n << "," << ops << ","
+             << fixed << setprecision(2) << nsPerOp << "," << setprecision(0) << opsPerSec << ","
+             << rss << "," << checksum << endl;
+    }
+}
+
+static vector<string> splitList(const string& list)
+{
+    vector<string> items;
+    stringstream ss(list);
+    string item;
+    while(getline(ss, item, ',')) {
+        if(!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+static int suite(int argc, char *argv[])
+{
+    SuiteOptions opt;
+    opt.format = "csv";
+    opt.engines = splitList("bst,avl,avl-hash,rb,map");
+    opt.workloads = splitList("insert,find-hit,find-miss,remove,iterate,mixed");
+    opt.dists = splitList("seq,random,zipf");
+    opt.sizes.push_back(1000);
+    opt.sizes.push_back(1000000);
+    // Unbalanced trees degrade to lists on sequential keys, so those
+    // runs are quadratic; skip them above this size.
+    uint64_t bstSeqLimit = 20000;
+
+    for(int i = 2; i + 1 < argc; i += 2) {
+        string flag = argv[i];
+        string val = argv[i + 1];
+        if(flag == "--format") opt.format = val;
+        else if(flag == "--engines") opt.engines = splitList(val);
+        else if(flag == "--workloads") opt.workloads = splitList(val);
+        else if(flag == "--keys") opt.dists = splitList(val);
+        else if(flag == "--bst-seq-limit") bstSeqLimit = strtoull(val.c_str(), NULL, 10);
+        else if(flag == "--sizes") {
+            opt.sizes.clear();
+            vector<string> sizes = splitList(val);
+            for(size_t j = 0; j < sizes.size(); j++) opt.sizes.push_back(strtoull(sizes[j].c_str(), NULL, 10));
+        }
+        else {
+            cerr << "unknown option " << flag << endl;
+            return 1;
+        }
+    }
+
+    if(opt.format == "json") cout << "[" << endl;
+    else cout << "engine,workload,keys,n,ops,ns_per_op,ops_per_sec,peak_rss_kb,checksum" << endl;
+
+    bool first = true;
+    for(size_t si = 0; si < opt.sizes.size(); si++) {
+        for(size_t di = 0; di < opt.dists.size(); di++) {
+            for(size_t wi = 0; wi < opt.workloads.size(); wi++) {
+                for(size_t ei = 0; ei < opt.engines.size(); ei++) {
+                    const string& engine = opt.engines[ei];
+                    const string& workload = opt.workloads[wi];
+                    const string& dist = opt.dists[di];
+                    uint64_t n = opt.sizes[si];
+                    if(engine == "bst" && dist == "seq" && n > bstSeqLimit) {
+                        cerr << "skipping bst/" << workload << "/seq/" << n << " (quadratic)" << endl;
+                        continue;
+                    }
+                    isolated([&]() {
+                        if(engine == "bst") suiteRun<BinarySearchTree<uint64_t, uint64_t> >(opt, "BinarySearchTree", workload, dist, n, first);
+                        else if(engine == "avl") suiteRun<AVLTree<uint64_t, uint64_t> >(opt, "AVLTree", workload, dist, n, first);
+                        else if(engine == "avl-hash") suiteRun<HashedAVLTree>(opt, "AVLTree+hash", workload, dist, n, first);
+                        else if(engine == "rb") suiteRun<RedBlackTree<uint64_t, uint64_t> >(opt, "RedBlackTree", workload, dist, n, first);
+                        else if(engine == "map") suiteRun<map<uint64_t, uint64_t> >(opt, "std::map", workload, dist, n, first);
+                        return true;
+                    });
+                    first = false;
+                }
+            }
+        }
+    }
+
+    if(opt.format == "json") cout << "]" << endl;
+    return 0;
+}
+
+static void usage()
+{
+    cerr << "usage: bst-bench churn [n] [ops]" << endl;
+    cerr << "       bst-bench hint [n]" << endl;
+    cerr << "       bst-bench insert [n...]" << endl;
+    cerr << "       bst-bench batch [n] [batch size]" << endl;
+    cerr << "       bst-bench integral [n...]" << endl;
+    cerr << "       bst-bench strings [n...]" << endl;
+    cerr << "       bst-bench scan [n...]" << endl;
+    cerr << "       bst-bench compact [n] [step]" << endl;
+    cerr << "       bst-bench bloom [n] [miss %] [bits/key]" << endl;
+    cerr << "       bst-bench expire [n] [batch]" << endl;
+    cerr << "       bst-bench aggregate [n]" << endl;
+    cerr << "       bst-bench intervals [n...]" << endl;
+    cerr << "       bst-bench copy [n]" << endl;
+    cerr << "       bst-bench suite [--format csv|json] [--sizes n,...] [--engines bst,avl,avl-hash,rb,map]" << endl;
+    cerr << "                       [--workloads insert,find-hit,find-miss,remove,iterate,mixed]" << endl;
+    cerr << "                       [--keys seq,random,zipf] [--bst-seq-limit n]" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2) {
+        usage();
+        return 1;
+    }
+    string mode = argv[1];
+
+    if(mode == "churn") {
+        uint64_t n = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000;
+        uint64_t ops = argc > 3 ? strtoull(argv[3], NULL, 10) : 1000000;
+        cout << left << setw(14) << "engine" << right << setw(12) << "n" << setw(12) << "ops"
+             << setw(12) << "ns/op" << setw(14) << "rotations/op" << endl;
+        isolated([&]() { churn<AVLTree<uint64_t, uint64_t> >("AVLTree", n, ops); return true; });
+        isolated([&]() { churn<RedBlackTree<uint64_t, uint64_t> >("RedBlackTree", n, ops); return true; });
+    }
+    else if(mode == "hint") {
+        uint64_t n = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000;
+        cout << left << setw(10) << "stream" << setw(10) << "insert" << right << setw(12) << "n"
+             << setw(12) << "ns/op" << endl;
+        const char* streams[] = { "sorted", "nearly", "random" };
+        for(int s = 0; s < 3; s++) {
+            for(int hinted = 0; hinted < 2; hinted++) {
+                isolated([&]() { hintedInsert<AVLTree<uint64_t, uint64_t> >(streams[s], n, hinted); return true; });
+            }
+        }
+    }
+    else if(mode == "insert") {
+        vector<uint64_t> sizes;
+        for(int i = 2; i < argc; i++) sizes.push_back(strtoull(argv[i], NULL, 10));
+        if(sizes.empty()) {
+            sizes.push_back(1000);
+            sizes.push_back(1000000);
+        }
+        cout << left << setw(14) << "engine" << right << setw(12) << "n" << setw(12) << "ns/insert" << endl;
+        for(size_t i = 0; i < sizes.size(); i++) {
+            isolated([&]() { insertRandom<AVLTree<uint64_t, uint64_t> >("AVLTree", sizes[i]); return true; });
+        }
+    }
+    else if(mode == "batch") {
+        uint64_t n = argc > 2 ? strtoull(argv[2], NULL, 10) : 4000000;
+        uint64_t batch = argc > 3 ? strtoull(argv[3], NULL, 10) : 256;
+        cout << left << setw(10) << "lookup" << right << setw(12) << "n" << setw(8) << "batch"
+             << setw(12) << "ns/lookup" << setw(14) << "lookups/sec" << endl;
+        for(int batched = 0; batched < 2; batched++) {
+            isolated([&]() { batchFind<AVLTree<uint64_t, uint64_t> >(n, batch, batched); return true; });
+        }
+    }
+    else if(mode == "integral") {
+        vector<uint64_t> sizes;
+        for(int i = 2; i < argc; i++) sizes.push_back(strtoull(argv[i], NULL, 10));
+        if(sizes.empty()) {
+            sizes.push_back(1000);
+            sizes.push_back(1000000);
+        }
+        cout << left << setw(10) << "descent" << right << setw(12) << "n" << setw(12) << "ns/insert"
+             << setw(12) << "ns/find" << endl;
+        for(size_t i = 0; i < sizes.size(); i++) {
+            isolated([&]() { integralDescent<BoxedKey>("generic", sizes[i]); return true; });
+            isolated([&]() { integralDescent<uint64_t>("integral", sizes[i]); return true; });
+        }
+    }
+    else if(mode == "strings") {
+        vector<uint64_t> sizes;
+        for(int i = 2; i < argc; i++) sizes.push_back(strtoull(argv[i], NULL, 10));
+        if(sizes.empty()) {
+            sizes.push_back(1000);
+            sizes.push_back(1000000);
+        }
+        cout << left << setw(16) << "key" << right << setw(12) << "n" << setw(12) << "ns/insert"
+             << setw(12) << "ns/find" << endl;
+        for(size_t i = 0; i < sizes.size(); i++) {
+            isolated([&]() { stringKeys<string>("std::string", sizes[i]); return true; });
+            isolated([&]() { stringKeys<PrefixedString>("PrefixedString", sizes[i]); return true; });
+        }
+    }
+    else if(mode == "scan") {
+        vector<uint64_t> sizes;
+        for(int i = 2; i < argc; i++) sizes.push_back(strtoull(argv[i], NULL, 10));
+        if(sizes.empty()) {
+            sizes.push_back(1000);
+            sizes.push_back(1000000);
+        }
+        cout << left << setw(18) << "engine" << setw(6) << "step" << right << setw(12) << "n"
+             << setw(12) << "ns/item" << setw(14) << "items/sec" << endl;
+        for(size_t i = 0; i < sizes.size(); i++) {
+            typedef AVLTree<uint64_t, uint64_t> Plain;
+            typedef ThreadedAVLTree<uint64_t, uint64_t> Threaded;
+            isolated([&]() { fullScan<Plain>("AVLTree", "++", sizes[i], scanForward<Plain>); return true; });
+            isolated([&]() { fullScan<Threaded>("ThreadedAVLTree", "++", sizes[i], scanForward<Threaded>); return true; });
+            isolated([&]() { fullScan<Threaded>("ThreadedAVLTree", "--", sizes[i], scanBackward<uint64_t, uint64_t>); return true; });
+        }
+    }
+    else if(mode == "compact") {
+        uint64_t n = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000;
+        uint64_t step = argc > 3 ? strtoull(argv[3], NULL, 10) : 4096;
+        cout << "AVLTree, n = " << n << endl;
+        cout << left << setw(16) << "layout" << right << setw(12) << "ns/find" << setw(12) << "ns/item" << endl;
+        isolated([&]() { compactAfterChurn<AVLTree<uint64_t, uint64_t> >(n, step); return true; });
+    }
+    else if(mode == "bloom") {
+        uint64_t n = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000;
+        double miss = argc > 3 ? atof(argv[3]) / 100 : 0.7;
+        double bits = argc > 4 ? atof(argv[4]) : 10;
+        cout << left << setw(10) << "filter" << right << setw(12) << "n" << setw(11) << "misses"
+             << setw(12) << "ns/find" << setw(17) << "filter size" << endl;
+        isolated([&]() { bloomFind<AVLTree<uint64_t, uint64_t> >(n, miss, 0); return true; });
+        isolated([&]() { bloomFind<AVLTree<uint64_t, uint64_t> >(n, miss, bits); return true; });
+    }
+    else if(mode == "expire") {
+        uint64_t n = argc > 2 ? strtoull(argv[2], NULL, 10) : 4000000;
+        uint64_t batch = argc > 3 ? strtoull(argv[3], NULL, 10) : 10000;
+        cout << left << setw(14) << "engine" << setw(10) << "expiry" << right << setw(12) << "n"
+             << setw(10) << "batch" << setw(12) << "ns/key" << setw(12) << "us/batch" << endl;
+        for(int ranged = 0; ranged < 2; ranged++) {
+            isolated([&]() { expireWindow<AVLTree<uint64_t, uint64_t> >("avl", n, batch, ranged); return true; });
+            isolated([&]() { expireWindow<RedBlackTree<uint64_t, uint64_t> >("rb", n, batch, ranged); return true; });
+        }
+    }
+    else if(mode == "aggregate") {
+        uint64_t n = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000;
+        cout << setw(12) << "n" << setw(10) << "range" << setw(14) << "us/scan" << setw(14) << "us/aggregate" << endl;
+        const double shares[] = { 0.0001, 0.01, 0.5 };
+        for(int i = 0; i < 3; i++) {
+            isolated([&]() { rangeSums(n, shares[i]); return true; });
+        }
+    }
+    else if(mode == "intervals") {
+        vector<uint64_t> sizes;
+        for(int i = 2; i < argc; i++) sizes.push_back(strtoull(argv[i], NULL, 10));
+        if(sizes.empty()) {
+            sizes.push_back(10000);
+            sizes.push_back(1000000);
+        }
+        cout << setw(12) << "n" << setw(12) << "hits" << setw(14) << "us/scan" << setw(14) << "us/stab" << endl;
+        for(size_t i = 0; i < sizes.size(); i++) {
+            isolated([&]() { stabIntervals(sizes[i]); return true; });
+        }
+    }
+    else if(mode == "copy") {
+        uint64_t n = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000;
+        cout << left << setw(14) << "engine" << right << setw(12) << "n" << setw(14) << "ns/item copy"
+             << setw(14) << "ns/item ins" << setw(12) << "ns/move" << endl;
+        isolated([&]() { copyTree<AVLTree<uint64_t, uint64_t> >("AVLTree", n); return true; });
+        isolated([&]() { copyTree<RedBlackTree<uint64_t, uint64_t> >("RedBlackTree", n); return true; });
+    }
+    else if(mode == "suite") {
+        return suite(argc, argv);
+    }
+    else {
+        usage();
+        return 1;
+    }
+    return 0;
+}
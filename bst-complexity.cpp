@@ -0,0 +1,182 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <map>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include "bst.h"
+#include "avlbst.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Asymptotic regression checks for AVLTree, in the spirit of the
+// RuntimeEvaluator tests in hw4_tests, but standalone and aimed at the
+// balanced tree under adversarial key orders.
+//
+// Each operation is timed at sizes 2^10 .. 2^max and divided by the time
+// std::map takes for the same operation at the same size. std::map has
+// the bound we expect, so the ratio stays flat unless the AVLTree grows
+// faster; dividing out the reference also cancels the cache effects
+// that make every tree slower per operation as it outgrows the caches.
+// A check fails when the ratio grows by more than halfway (in log
+// space) toward the next complexity class. Exits with 1 on failure.
+
+enum Complexity { CONSTANT, LOGARITHMIC, LINEAR };
+
+static double model(Complexity c, double n)
+{
+    switch(c) {
+    case CONSTANT: return 1.0;
+    case LOGARITHMIC: return log2(n);
+    default: return n;
+    }
+}
+
+static const char* complexityName(Complexity c)
+{
+    switch(c) {
+    case CONSTANT: return "O(1)";
+    case LOGARITHMIC: return "O(log n)";
+    default: return "O(n)";
+    }
+}
+
+// Indices 0..n-1 in the given order. "zigzag" alternates between the
+// smallest and largest remaining index.
+static vector<uint64_t> makeOrder(const string& order, uint64_t n)
+{
+    vector<uint64_t> idx(n);
+    for(uint64_t i = 0; i < n; i++) {
+        if(order == "sorted") idx[i] = i;
+        else if(order == "reverse") idx[i] = n - 1 - i;
+        else idx[i] = (i % 2 == 0) ? i / 2 : n - 1 - i / 2;
+    }
+    return idx;
+}
+
+static const int REPS = 5;
+static volatile uint64_t sink;   // keeps the timed lookups from being optimized away
+static const uint64_t OPS = 4096;
+
+// Returns the best-of-REPS ns per op of one operation on a tree holding
+// the even keys 0..2n-2, inserted in the given order. Inserts use the odd
+// keys in between and are undone afterwards, removes are undone too, so
+// every rep sees the same tree size.
+template<typename Tree>
+double measure(Tree& tree, const string& op, const vector<uint64_t>& order)
+{
+    uint64_t n = order.size();
+    uint64_t m = OPS < n ? OPS : n;
+    vector<uint64_t> sample(m);
+    for(uint64_t j = 0; j < m; j++) sample[j] = order[j * n / m];
+
+    double best = 1e30;
+    uint64_t checksum = 0;
+    for(int rep = 0; rep < REPS; rep++) {
+        uint64_t start = nowNs();
+        uint64_t ops = m;
+        if(op == "insert") {
+            for(uint64_t j = 0; j < m; j++) put(tree, 2 * sample[j] + 1, j);
+        }
+        else if(op == "remove") {
+            for(uint64_t j = 0; j < m; j++) erase(tree, 2 * sample[j]);
+        }
+        else if(op == "find") {
+            for(uint64_t j = 0; j < m; j++) checksum += contains(tree, 2 * sample[j]);
+        }
+        else {
+            ops = 0;
+            for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+                checksum += it->second;
+                ops++;
+            }
+        }
+        double ns = (double)(nowNs() - start) / ops;
+        if(ns < best) best = ns;
+
+        if(op == "insert") {
+            for(uint64_t j = 0; j < m; j++) erase(tree, 2 * sample[j] + 1);
+        }
+        else if(op == "remove") {
+            for(uint64_t j = 0; j < m; j++) put(tree, 2 * sample[j], sample[j]);
+        }
+    }
+    sink = checksum;
+    return best;
+}
+
+struct Check
+{
+    const char* op;
+    Complexity bound;
+};
+
+int main(int argc, char *argv[])
+{
+    int maxLog = argc > 1 ? atoi(argv[1]) : 20;
+    const int minLog = 10;
+    if(maxLog < minLog + 2) {
+        cerr << "usage: bst-complexity [max log2 size >= " << minLog + 2 << "]" << endl;
+        return 1;
+    }
+
+    const Check checks[] = {
+        { "insert", LOGARITHMIC },
+        { "remove", LOGARITHMIC },
+        { "find", LOGARITHMIC },
+        { "++", CONSTANT },
+    };
+    const int numChecks = sizeof(checks) / sizeof(checks[0]);
+    const char* orders[] = { "sorted", "reverse", "zigzag" };
+
+    // ratio[order][check][size]
+    vector<vector<vector<double> > > ratio(3, vector<vector<double> >(numChecks));
+    vector<uint64_t> sizes;
+    for(int lg = minLog; lg <= maxLog; lg += 2) sizes.push_back(1ULL << lg);
+
+    cout << left << setw(8) << "order" << setw(8) << "op" << right << setw(10) << "n"
+         << setw(12) << "avl ns/op" << setw(12) << "map ns/op" << setw(10) << "ratio" << endl;
+    for(int o = 0; o < 3; o++) {
+        for(size_t si = 0; si < sizes.size(); si++) {
+            vector<uint64_t> order = makeOrder(orders[o], sizes[si]);
+            AVLTree<uint64_t, uint64_t> avl;
+            map<uint64_t, uint64_t> ref;
+            for(size_t i = 0; i < order.size(); i++) {
+                put(avl, 2 * order[i], order[i]);
+                put(ref, 2 * order[i], order[i]);
+            }
+            for(int c = 0; c < numChecks; c++) {
+                double a = measure(avl, checks[c].op, order);
+                double r = measure(ref, checks[c].op, order);
+                ratio[o][c].push_back(a / r);
+                cout << left << setw(8) << orders[o] << setw(8) << checks[c].op << right
+                     << setw(10) << sizes[si] << fixed << setprecision(1) << setw(12) << a
+                     << setw(12) << r << setprecision(2) << setw(10) << a / r << endl;
+            }
+        }
+    }
+
+    cout << endl;
+    bool ok = true;
+    double n0 = sizes.front(), n1 = sizes.back();
+    for(int o = 0; o < 3; o++) {
+        for(int c = 0; c < numChecks; c++) {
+            Complexity bound = checks[c].bound;
+            Complexity next = (Complexity)(bound + 1);
+            double expected = model(bound, n1) / model(bound, n0);
+            double worse = model(next, n1) / model(next, n0);
+            double limit = sqrt(worse / expected);
+            double growth = ratio[o][c].back() / ratio[o][c].front();
+            bool pass = growth <= limit;
+            ok = ok && pass;
+            cout << (pass ? "PASS " : "FAIL ") << left << setw(8) << orders[o] << setw(8) << checks[c].op
+                 << complexityName(bound) << right << ": ratio grew " << fixed << setprecision(2)
+                 << growth << "x from n=" << sizes.front() << " to n=" << sizes.back()
+                 << " (limit " << limit << "x)" << endl;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <map>
+#include <random>
+#include <cstdlib>
+#include <cstdint>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbbst.h"
+#include "bst_stats.h"
+#include "bst_trace.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Replays an operation trace written by TraceRecorder (bst_trace.h)
+// against each engine and reports throughput and per-operation latency.
+//
+//   bst-replay <trace> [engine...]      engines: bst, avl, rb, map
+//                                       (default avl rb map)
+//   bst-replay record <trace> [n]       writes a synthetic trace of n ops
+//                                       through an AVLTree, for trying
+//                                       the tool out
+//
+// Every engine replays in its own process (see isolated()). Each op is
+// timed on its own, so the latencies include ~20ns of clock overhead;
+// the throughput figure is taken over the whole replay and includes it
+// too, which affects every engine alike.
+
+static volatile uint64_t sink;   // keeps the replayed lookups from being optimized away
+
+struct Replay
+{
+    LatencyHistogram all;
+    LatencyHistogram byOp[TRACE_ITERATE + 1];
+    uint64_t ns;
+    uint64_t checksum;
+};
+
+template<typename Tree>
+static void replayOp(Tree& tree, const TraceOp& op, uint64_t value, uint64_t& checksum)
+{
+    switch(op.opcode) {
+    case TRACE_INSERT:
+        put(tree, op.key, value);
+        break;
+    case TRACE_FIND:
+        checksum += contains(tree, op.key);
+        break;
+    case TRACE_REMOVE:
+        erase(tree, op.key);
+        break;
+    default: {
+        typename Tree::iterator it = op.fromBegin ? tree.begin() : tree.find(op.key);
+        for(uint64_t i = 0; i < op.steps && it != tree.end(); i++, ++it) {
+            checksum += it->second;
+        }
+        break;
+    }
+    }
+}
+
+template<typename Tree>
+static void replay(const vector<TraceOp>& ops, Replay& result)
+{
+    Tree tree;
+    uint64_t checksum = 0;
+    uint64_t start = nowNs();
+    for(size_t i = 0; i < ops.size(); i++) {
+        uint64_t t0 = nowNs();
+        replayOp(tree, ops[i], i, checksum);
+        uint64_t ns = nowNs() - t0;
+        result.all.record(ns);
+        result.byOp[ops[i].opcode].record(ns);
+    }
+    result.ns = nowNs() - start;
+    result.checksum = checksum;
+    sink = checksum;
+}
+
+static bool runEngine(const string& engine, const vector<TraceOp>& ops)
+{
+    Replay* result = new Replay();
+    if(engine == "bst") replay<BinarySearchTree<uint64_t, uint64_t> >(ops, *result);
+    else if(engine == "avl") replay<AVLTree<uint64_t, uint64_t> >(ops, *result);
+    else if(engine == "rb") replay<RedBlackTree<uint64_t, uint64_t> >(ops, *result);
+    else if(engine == "map") replay<map<uint64_t, uint64_t> >(ops, *result);
+    else {
+        cerr << "unknown engine " << engine << endl;
+        delete result;
+        return false;
+    }
+
+    static const char* names[] = { "", "insert", "find", "remove", "iterate" };
+    cout << engine << ": " << fixed << setprecision(0)
+         << ops.size() * 1e9 / result->ns << " ops/sec"
+         << "  peak RSS " << peakRssKb() << " KB"
+         << "  checksum " << result->checksum << endl;
+    result->all.print(cout, "all");
+    for(int op = TRACE_INSERT; op <= TRACE_ITERATE; op++) {
+        if(result->byOp[op].count() > 0) result->byOp[op].print(cout, names[op]);
+    }
+    cout << endl;
+    delete result;
+    return true;
+}
+
+// A synthetic trace: a growing, mostly ascending key space with Zipf-ish
+// reads, some deletes and the odd short scan.
+static int record(const string& path, uint64_t n)
+{
+    ofstream out(path.c_str(), ios::binary);
+    if(!out) {
+        cerr << "cannot write " << path << endl;
+        return 1;
+    }
+    AVLTree<uint64_t, uint64_t> tree;
+    TraceRecorder<AVLTree<uint64_t, uint64_t> > recorder(tree, out);
+    mt19937_64 rng(42);
+    uint64_t next = 0;
+    for(uint64_t i = 0; i < n; i++) {
+        uint64_t r = rng() % 100;
+        if(r < 30 || next == 0) {
+            recorder.insert(make_pair(next++, i));
+        }
+        else if(r < 35) {
+            recorder.remove(rng() % next);
+        }
+        else if(r < 99) {
+            // skew reads toward recent keys
+            uint64_t back = rng() % next;
+            back = back * back / next;
+            recorder.find(next - 1 - back);
+        }
+        else {
+            recorder.iterateFrom(rng() % next, 16, [](const pair<const uint64_t, uint64_t>&) { });
+        }
+    }
+    cout << "wrote " << recorder.records() << " records to " << path << endl;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2) {
+        cerr << "usage: bst-replay <trace> [bst|avl|rb|map ...]" << endl
+             << "       bst-replay record <trace> [ops]" << endl;
+        return 1;
+    }
+    string first = argv[1];
+    if(first == "record") {
+        if(argc < 3) {
+            cerr << "usage: bst-replay record <trace> [ops]" << endl;
+            return 1;
+        }
+        return record(argv[2], argc > 3 ? strtoull(argv[3], NULL, 10) : 1000000);
+    }
+
+    ifstream in(first.c_str(), ios::binary);
+    TraceReader reader(in);
+    if(!in || !reader.valid()) {
+        cerr << first << " is not a trace" << endl;
+        return 1;
+    }
+    vector<TraceOp> ops;
+    TraceOp op;
+    while(reader.next(op)) ops.push_back(op);
+    if(!in.eof()) {
+        cerr << first << ": bad record after " << ops.size() << " operations" << endl;
+        return 1;
+    }
+    cout << "replaying " << ops.size() << " operations" << endl << endl;
+
+    vector<string> engines;
+    for(int i = 2; i < argc; i++) engines.push_back(argv[i]);
+    if(engines.empty()) {
+        engines.push_back("avl");
+        engines.push_back("rb");
+        engines.push_back("map");
+    }
+    bool ok = true;
+    for(size_t i = 0; i < engines.size(); i++) {
+        const string& engine = engines[i];
+        ok = isolated([&]() { return runEngine(engine, ops); }) && ok;
+    }
+    return ok ? 0 : 1;
+}
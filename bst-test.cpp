@@ -1,10 +1,1499 @@
 #include <iostream>
 #include <map>
+#include <sstream>
+#include <string>
+#include <cstdio>
+#include <cmath>
+#include <new>
 #include "bst.h"
 #include "avlbst.h"
+#include "rbbst.h"
+#include "threadedavl.h"
+#include "augmentedavl.h"
+#include "intervaltree.h"
+#include "bst_trace.h"
+#include "bst_string_key.h"
 
 using namespace std;
 
+// Counts heap allocations so the tests can check that the tree's hot
+// paths only allocate the nodes themselves.
+static size_t allocations = 0;
+
+void* operator new(size_t size)
+{
+    allocations++;
+    void* p = malloc(size == 0 ? 1 : size);
+    if(p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+// Exposes the root of a tree so the tests can check its structure.
+template<typename Tree>
+class Inspect : public Tree
+{
+public:
+    typedef typename Tree::iterator iterator;
+    template<typename NodeT>
+    NodeT* root() const { return static_cast<NodeT*>(this->root_); }
+    // the compact() blocks still allocated; freed ones wait to be swept
+    size_t blocks() const
+    {
+        size_t n = 0;
+        for(size_t i = 0; i < this->blocks_.size(); i++) {
+            if(this->blocks_[i].start != this->blocks_[i].end) n++;
+        }
+        return n;
+    }
+};
+
+// Returns the black height of the subtree, or -1 if a red-black
+// property or a parent pointer is broken.
+template<typename Key, typename Value>
+int blackHeight(RBNode<Key, Value>* node, RBNode<Key, Value>* parent)
+{
+    if(node == NULL) return 1;
+    if(node->getParent() != parent) return -1;
+    if(node->isRed() && parent != NULL && parent->isRed()) return -1;
+    int lh = blackHeight(node->getLeft(), node);
+    int rh = blackHeight(node->getRight(), node);
+    if(lh < 0 || lh != rh) return -1;
+    return lh + (node->isRed() ? 0 : 1);
+}
+
+// Returns the height of the subtree, or -1 if a stored balance, the AVL
+// property or a parent pointer is broken.
+template<typename Key, typename Value>
+int avlHeight(AVLNode<Key, Value>* node, AVLNode<Key, Value>* parent)
+{
+    if(node == NULL) return 0;
+    if(node->getParent() != parent) return -1;
+    int lh = avlHeight(node->getLeft(), node);
+    int rh = avlHeight(node->getRight(), node);
+    if(lh < 0 || rh < 0 || lh - rh != node->getBalance() || abs(lh - rh) > 1) return -1;
+    return 1 + max(lh, rh);
+}
+
+// Returns the height of the subtree, or -1 if a parent pointer is broken.
+template<typename Key, typename Value>
+int linkedHeight(Node<Key, Value>* node, Node<Key, Value>* parent)
+{
+    if(node == NULL) return 0;
+    if(node->getParent() != parent) return -1;
+    int lh = linkedHeight(node->getLeft(), node);
+    int rh = linkedHeight(node->getRight(), node);
+    if(lh < 0 || rh < 0) return -1;
+    return 1 + max(lh, rh);
+}
+
+// Checks that an in-order walk of the tree visits exactly the keys of ref.
+template<typename Tree>
+bool sameContents(const Tree& tree, const map<int,int>& ref)
+{
+    map<int,int>::const_iterator r = ref.begin();
+    for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it, ++r) {
+        if(r == ref.end() || it->first != r->first || it->second != r->second) return false;
+    }
+    return r == ref.end();
+}
+
+bool testRedBlackChurn()
+{
+    Inspect<RedBlackTree<int,int> > rt;
+    map<int,int> ref;
+    srand(104);
+    for(int i = 0; i < 20000; i++) {
+        int k = rand() % 2000;
+        size_t before = rt.rotations();
+        if(rand() % 3 == 0) {
+            rt.remove(k);
+            ref.erase(k);
+            if(rt.rotations() - before > 3) return false;
+        }
+        else {
+            rt.insert(std::make_pair(k, i));
+            ref[k] = i;
+            if(rt.rotations() - before > 2) return false;
+        }
+        if(i % 97 == 0 && blackHeight(rt.root<RBNode<int,int> >(), (RBNode<int,int>*)NULL) < 0) return false;
+    }
+    return sameContents(rt, ref) && blackHeight(rt.root<RBNode<int,int> >(), (RBNode<int,int>*)NULL) >= 0;
+}
+
+
+// Inserts with hints that are sometimes useful and sometimes far away,
+// and checks the tree ends up with the same contents as plain inserts.
+template<typename Tree>
+bool hintedInserts(Tree& tree, map<int,int>& ref)
+{
+    srand(42);
+    typename Tree::iterator hint = tree.end();
+    for(int i = 0; i < 5000; i++) {
+        int k = (i % 3 == 0) ? rand() % 10000 : i * 2 + rand() % 7;
+        if(i % 10 == 0) hint = tree.find(rand() % 10000);
+        hint = tree.insert(hint, std::make_pair(k, i));
+        ref[k] = i;
+        if(hint == tree.end() || hint->first != k) return false;
+        int probe = (i % 2 == 0) ? k + rand() % 5 - 2 : rand() % 10000;
+        if((tree.find(hint, probe) != tree.end()) != (ref.count(probe) == 1)) return false;
+    }
+    return sameContents(tree, ref);
+}
+
+bool testHintedInsert()
+{
+    map<int,int> ref1, ref2, ref3;
+    Inspect<BinarySearchTree<int,int> > bt;
+    Inspect<AVLTree<int,int> > at;
+    Inspect<RedBlackTree<int,int> > rt;
+    if(!hintedInserts(bt, ref1)) return false;
+    if(!hintedInserts(at, ref2) || avlHeight(at.root<AVLNode<int,int> >(), (AVLNode<int,int>*)NULL) < 0) return false;
+    if(!hintedInserts(rt, ref3) || blackHeight(rt.root<RBNode<int,int> >(), (RBNode<int,int>*)NULL) < 0) return false;
+    for(map<int,int>::iterator it = ref2.begin(); it != ref2.end(); ++it) {
+        if(at.find(at.begin(), it->first) == at.end()) return false;
+    }
+    return true;
+}
+
+bool testAVLAllocations()
+{
+    AVLTree<int,int> at;
+    srand(7);
+    for(int i = 0; i < 20000; i++) {
+        int k = rand() % 5000;
+        bool present = at.find(k) != at.end();
+        size_t before = allocations;
+        if(i % 4 == 0) {
+            at.remove(k);
+            if(allocations != before) return false;
+        }
+        else {
+            at.insert(std::make_pair(k, i));
+            if(allocations - before != (present ? 0u : 1u)) return false;
+        }
+    }
+    return true;
+}
+
+// Moves every other key from an "active" tree to an "aged" one through
+// node handles and checks that no node is allocated or copied.
+template<typename Tree>
+bool moveNodes(Tree& active, Tree& aged, map<int,int>& activeRef, map<int,int>& agedRef)
+{
+    for(int i = 0; i < 2000; i++) {
+        active.insert(std::make_pair(i * 7 % 2000, i));
+        activeRef[i * 7 % 2000] = i;
+    }
+    for(int k = 0; k < 2000; k += 2) {
+        const std::pair<const int,int>* item = &*active.find(k);
+        size_t before = allocations;
+        typename Tree::node_handle nh = active.extract(k);
+        if(nh.empty() || nh.key() != k) return false;
+        nh.mapped() += 1;
+        std::pair<typename Tree::iterator, bool> res = aged.insert(std::move(nh));
+        if(allocations != before) return false;
+        if(!res.second || !nh.empty() || &*res.first != item) return false;
+        agedRef[k] = activeRef[k] + 1;
+        activeRef.erase(k);
+    }
+
+    // a duplicate key leaves the node in the handle
+    typename Tree::node_handle dup = active.extract(1);
+    aged.insert(std::make_pair(1, -1));
+    agedRef[1] = -1;
+    activeRef.erase(1);
+    std::pair<typename Tree::iterator, bool> res = aged.insert(std::move(dup));
+    if(res.second || dup.empty() || res.first->second != -1) return false;
+    if(!active.extract(5000).empty()) return false;
+
+    return sameContents(active, activeRef) && sameContents(aged, agedRef);
+}
+
+// True if a From::node_handle can be inserted into a To.
+template<typename To, typename From>
+struct AcceptsHandle
+{
+    template<typename T>
+    static char test(decltype(std::declval<T&>().insert(std::declval<typename From::node_handle>()))*);
+    template<typename T>
+    static long test(...);
+    static const bool value = sizeof(test<To>(0)) == 1;
+};
+
+bool testNodeHandles()
+{
+    // a node only moves between trees of the same kind
+    static_assert(AcceptsHandle<AVLTree<int,int>, AVLTree<int,int> >::value, "same tree");
+    static_assert(!AcceptsHandle<AVLTree<int,int>, RedBlackTree<int,int> >::value, "RB into AVL");
+    static_assert(!AcceptsHandle<RedBlackTree<int,int>, AVLTree<int,int> >::value, "AVL into RB");
+    static_assert(!AcceptsHandle<AVLTree<int,int>, BinarySearchTree<int,int> >::value, "BST into AVL");
+    static_assert(!AcceptsHandle<ThreadedAVLTree<int,int>, AVLTree<int,int> >::value, "AVL into threaded");
+    static_assert(!AcceptsHandle<AugmentedAVLTree<int,int,SumAggregate<int> >, AVLTree<int,int> >::value,
+                  "AVL into augmented");
+
+    map<int,int> r1, r2, r3, r4, r5, r6;
+    BinarySearchTree<int,int> b1, b2;
+    Inspect<AVLTree<int,int> > a1, a2;
+    Inspect<RedBlackTree<int,int> > t1, t2;
+    if(!moveNodes(b1, b2, r1, r2)) return false;
+    if(!moveNodes(a1, a2, r3, r4)) return false;
+    if(avlHeight(a1.root<AVLNode<int,int> >(), (AVLNode<int,int>*)NULL) < 0) return false;
+    if(avlHeight(a2.root<AVLNode<int,int> >(), (AVLNode<int,int>*)NULL) < 0) return false;
+    if(!moveNodes(t1, t2, r5, r6)) return false;
+    if(blackHeight(t1.root<RBNode<int,int> >(), (RBNode<int,int>*)NULL) < 0) return false;
+    if(blackHeight(t2.root<RBNode<int,int> >(), (RBNode<int,int>*)NULL) < 0) return false;
+
+    // through base references the types only meet at run time; a node
+    // of the wrong type is refused and stays with its handle
+    BinarySearchTree<int,int> plain;
+    Inspect<AVLTree<int,int> > avl;
+    ThreadedAVLTree<int,int> threaded;
+    for(int i = 0; i < 10; i++) {
+        plain.insert(std::make_pair(i, i));
+        avl.insert(std::make_pair(i, i));
+    }
+    BinarySearchTree<int,int>& toAvl = avl;
+    AVLTree<int,int>& toThreaded = threaded;
+    BinarySearchTree<int,int>::node_handle foreign = plain.extract(5);
+    AVLTree<int,int>::node_handle unthreaded = avl.extract(5);
+    try {
+        toAvl.insert(std::move(foreign));
+        return false;
+    }
+    catch(std::invalid_argument&) {
+    }
+    try {
+        toThreaded.insert(std::move(unthreaded));
+        return false;
+    }
+    catch(std::invalid_argument&) {
+    }
+    if(foreign.empty() || foreign.key() != 5 || unthreaded.empty() || unthreaded.key() != 5) return false;
+    if(avl.size() != 9 || !threaded.empty()) return false;
+    // the tree's own nodes still go back in through the base
+    BinarySearchTree<int,int>::node_handle own = toAvl.extract(6);
+    if(!toAvl.insert(std::move(own)).second || !own.empty() || avl.size() != 9) return false;
+    return avlHeight(avl.root<AVLNode<int,int> >(), (AVLNode<int,int>*)NULL) >= 0;
+}
+
+// With BST_STATS the counters must track the operations; without it
+// stats() must still work and report only the rotations.
+bool testStats()
+{
+    AVLTree<int,int> at;
+    for(int i = 0; i < 1000; i++) at.insert(std::make_pair(i, i));
+    for(int i = 0; i < 1000; i += 2) at.find(i);
+    for(int i = 1; i < 1000; i += 3) at.remove(i);
+    BSTStats st = at.stats();
+    if(st.rotations != at.rotations() || st.rotations == 0) return false;
+#ifdef BST_STATS
+    if(st.allocations != 1000 || st.frees != 333 || st.liveNodes() != 667) return false;
+    if(st.nodeBytes != sizeof(AVLNode<int,int>) || st.bytesPerEntry() < st.nodeBytes) return false;
+    if(st.insertLatency.count() != 1000 || st.findLatency.count() != 500 || st.removeLatency.count() != 333) return false;
+    if(st.lookups != 833 || st.nodeSwaps == 0) return false;
+    // a balanced tree of 1000 nodes is at most 14 levels deep
+    if(st.comparisonsPerLookup() > 2 * 14) return false;
+    if(st.findLatency.percentile(50) > st.findLatency.percentile(99.9)) return false;
+    at.resetStats();
+    if(at.stats().lookups != 0 || at.stats().liveNodes() != 667) return false;
+#else
+    if(st.allocations != 0 || st.lookups != 0 || st.insertLatency.count() != 0) return false;
+#endif
+    return true;
+}
+
+// Integral keys take the branchless descent and strings the generic
+// one; the same random workload must give the same tree contents.
+bool testKeyPaths()
+{
+    Inspect<AVLTree<long,int> > at;
+    Inspect<AVLTree<std::string,int> > st;
+    map<long,int> ref;
+    srand(35);
+    for(int i = 0; i < 5000; i++) {
+        long k = rand() % 1000;
+        char buf[8];
+        sprintf(buf, "%04ld", k);
+        if(rand() % 4 == 0) {
+            at.remove(k);
+            st.remove(buf);
+            ref.erase(k);
+        }
+        else {
+            at.insert(std::make_pair(k, i));
+            st.insert(std::make_pair(std::string(buf), i));
+            ref[k] = i;
+        }
+    }
+    if(avlHeight(at.root<AVLNode<long,int> >(), (AVLNode<long,int>*)NULL) < 0) return false;
+    if(avlHeight(st.root<AVLNode<std::string,int> >(), (AVLNode<std::string,int>*)NULL) < 0) return false;
+    map<long,int>::iterator r = ref.begin();
+    AVLTree<std::string,int>::iterator s = st.begin();
+    for(AVLTree<long,int>::iterator a = at.begin(); a != at.end(); ++a, ++s, ++r) {
+        if(r == ref.end() || s == st.end()) return false;
+        if(a->first != r->first || a->second != r->second) return false;
+        if(atol(s->first.c_str()) != r->first || s->second != r->second) return false;
+        if(at.find(a->first) != a || st.find(s->first) != s) return false;
+    }
+    return r == ref.end() && s == st.end() && at.find(1000) == at.end() && st.find("1000") == st.end();
+}
+
+// PrefixedString must order exactly like std::string, including keys
+// that tie on their 8-byte prefix, are shorter than it, or contain NULs.
+bool testPrefixedString()
+{
+    std::vector<std::string> words;
+    const char* base[] = { "", "a", "ab", "abc", "abcdefgh", "abcdefgh1", "abcdefgh2", "abcdefghi",
+                           "abcdefg", "b", "ba", "\xff", "\x80z", "zzzzzzzzzzzzzzzzzzzz" };
+    for(size_t i = 0; i < sizeof(base) / sizeof(base[0]); i++) words.push_back(base[i]);
+    words.push_back(std::string("a\0", 2));
+    words.push_back(std::string("abcdefgh\0", 9));
+    for(size_t i = 0; i < words.size(); i++) {
+        for(size_t j = 0; j < words.size(); j++) {
+            PrefixedString a(words[i]), b(words[j]);
+            if((a < b) != (words[i] < words[j]) || (a == b) != (words[i] == words[j])) return false;
+        }
+    }
+
+    AVLTree<PrefixedString,int> at;
+    map<std::string,int> ref;
+    srand(36);
+    for(int i = 0; i < 3000; i++) {
+        std::string k = words[rand() % words.size()] + (char)('a' + rand() % 4);
+        if(rand() % 4 == 0) {
+            at.remove(k);
+            ref.erase(k);
+        }
+        else {
+            at.insert(std::make_pair(PrefixedString(k), i));
+            ref[k] = i;
+        }
+    }
+    map<std::string,int>::iterator r = ref.begin();
+    for(AVLTree<PrefixedString,int>::iterator it = at.begin(); it != at.end(); ++it, ++r) {
+        if(r == ref.end() || it->first.str() != r->first || it->second != r->second) return false;
+    }
+    return r == ref.end() && at.find("abcdefgh1") == at.end()
+        && std::hash<PrefixedString>()("url") == std::hash<std::string>()("url");
+}
+
+// findBatch() must agree with find() for hits and misses, on batches
+// larger and smaller than its lane count.
+template<typename Tree>
+bool batchMatchesFind()
+{
+    Tree tree;
+    for(int i = 0; i < 500; i++) tree.insert(std::make_pair(i * 37 % 1000, i));
+    for(size_t size = 0; size <= 100; size += 7) {
+        std::vector<int> keys;
+        for(size_t j = 0; j < size; j++) keys.push_back((int)(j * 131 % 1000));
+        std::vector<typename Tree::iterator> out;
+        tree.findBatch(keys, out);
+        if(out.size() != keys.size()) return false;
+        for(size_t j = 0; j < size; j++) {
+            if(out[j] != tree.find(keys[j])) return false;
+        }
+    }
+    return true;
+}
+
+bool testFindBatch()
+{
+    return batchMatchesFind<BinarySearchTree<int,int> >() && batchMatchesFind<AVLTree<int,int> >()
+        && batchMatchesFind<RedBlackTree<int,int> >();
+}
+
+bool testShapeStats()
+{
+    BinarySearchTree<int,int> empty;
+    ShapeStats es = empty.shapeStats();
+    if(es.nodes != 0 || es.height != 0 || es.leaves != 0) return false;
+
+    // a perfect tree of 7 nodes
+    BinarySearchTree<int,int> bt;
+    const int perfect[] = { 4, 2, 6, 1, 3, 5, 7 };
+    for(int i = 0; i < 7; i++) bt.insert(std::make_pair(perfect[i], i));
+    ShapeStats ps = bt.shapeStats();
+    if(ps.nodes != 7 || ps.leaves != 4 || ps.height != 3 || ps.unbalancedNodes != 0) return false;
+    if(ps.leafDepths.size() != 4 || ps.leafDepths[3] != 4) return false;
+    if(fabs(ps.averageDepth - 17.0 / 7) > 1e-9 || fabs(ps.comparisonsPerHit - (34.0 / 7 - 1)) > 1e-9) return false;
+
+    // sorted inserts degrade the plain tree into a chain
+    BinarySearchTree<int,int> chain;
+    for(int i = 0; i < 2000; i++) chain.insert(std::make_pair(i, i));
+    ShapeStats cs = chain.shapeStats();
+    if(cs.nodes != 2000 || cs.leaves != 1 || cs.height != 2000 || cs.leafDepths[2000] != 1) return false;
+    if(cs.unbalancedNodes != 1998 || fabs(cs.averageDepth - 1000.5) > 1e-9) return false;
+
+    // and not the AVL tree
+    AVLTree<int,int> at;
+    for(int i = 0; i < 2000; i++) at.insert(std::make_pair(i, i));
+    ShapeStats as = at.shapeStats();
+    size_t leaves = 0;
+    for(size_t d = 0; d < as.leafDepths.size(); d++) leaves += as.leafDepths[d];
+    return as.nodes == 2000 && as.unbalancedNodes == 0 && at.isBalanced() && as.height <= 16
+        && leaves == as.leaves && as.maxDepth == as.height;
+}
+
+// rebalance() must produce a complete tree of minimal height for every
+// size, and auto-rebalancing must keep sorted inserts logarithmic.
+bool testRebalance()
+{
+    for(int n = 0; n <= 70; n++) {
+        Inspect<BinarySearchTree<int,int> > bt;
+        map<int,int> ref;
+        for(int i = 0; i < n; i++) {
+            bt.insert(std::make_pair(i, -i));
+            ref[i] = -i;
+        }
+        bt.rebalance();
+        int minHeight = 0;
+        while((1 << minHeight) - 1 < n) minHeight++;
+        ShapeStats shape = bt.shapeStats();
+        if(bt.size() != (size_t)n || shape.height != minHeight || shape.unbalancedNodes != 0) return false;
+        // complete: all leaves on the last two levels
+        for(int d = 0; d + 1 < minHeight && d < (int)shape.leafDepths.size(); d++) {
+            if(shape.leafDepths[d] != 0) return false;
+        }
+        if(!sameContents(bt, ref) || linkedHeight(bt.root<Node<int,int> >(), (Node<int,int>*)NULL) != minHeight) return false;
+    }
+
+    Inspect<BinarySearchTree<int,int> > auto_;
+    map<int,int> ref;
+    auto_.setAutoRebalance(2.0);
+    const int n = 100000;
+    for(int i = 0; i < n; i++) {
+        auto_.insert(std::make_pair(i, i));
+        ref[i] = i;
+    }
+    for(int i = 0; i < n; i += 3) {
+        auto_.remove(i);
+        ref.erase(i);
+    }
+    BinarySearchTree<int,int>::node_handle nh = auto_.extract(1);
+    ref.erase(1);
+    if(auto_.size() != ref.size()) return false;
+    auto_.insert(std::move(nh));
+    ref[1] = 1;
+    if(auto_.size() != ref.size() || auto_.shapeStats().height > 2 * 17 + 1) return false;
+    if(!sameContents(auto_, ref) || linkedHeight(auto_.root<Node<int,int> >(), (Node<int,int>*)NULL) < 0) return false;
+
+    // a no-op for the balancing trees
+    Inspect<AVLTree<int,int> > at;
+    for(int i = 0; i < 100; i++) at.insert(std::make_pair(i, i));
+    at.rebalance();
+    return at.size() == 100 && avlHeight(at.root<AVLNode<int,int> >(), (AVLNode<int,int>*)NULL) >= 0;
+}
+
+// A value whose copy constructor throws for negative values, so an
+// insert can fail after its key has been placed.
+struct Fragile
+{
+    Fragile() : v(0) { }
+    Fragile(int v) : v(v) { }
+    Fragile(const Fragile& other) : v(other.v)
+    {
+        if(v < 0) throw std::runtime_error("fragile");
+    }
+    Fragile& operator=(const Fragile& other)
+    {
+        v = other.v;
+        return *this;
+    }
+    int v;
+};
+
+// printRoot() needs the value printable even though nothing here calls it
+std::ostream& operator<<(std::ostream& os, const Fragile& f)
+{
+    return os << f.v;
+}
+
+// Inserts keys in order, every seventh with a value that throws; the
+// failed inserts must leave no trace, not even in size().
+template<typename Tree>
+bool failInserts(Tree& tree)
+{
+    size_t kept = 0;
+    for(int i = 0; i < 1000; i++) {
+        if(i % 7 == 0) {
+            std::pair<const int,Fragile> bad(std::piecewise_construct, std::forward_as_tuple(i), std::forward_as_tuple(-i - 1));
+            try {
+                tree.insert(bad);
+                return false;
+            }
+            catch(std::runtime_error&) {
+            }
+            if(tree.find(i) != tree.end()) return false;
+        }
+        else {
+            tree.insert(std::make_pair(i, Fragile(i)));
+            kept++;
+        }
+        if(tree.size() != kept) return false;
+    }
+    size_t n = 0;
+    for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it, n++) {
+        if(it->first % 7 == 0 || it->second.v != it->first) return false;
+    }
+    return n == kept;
+}
+
+bool testThrowingInsert()
+{
+    // auto-rebalancing reads size(), and the hash index must not keep
+    // the failed node
+    Inspect<BinarySearchTree<int,Fragile> > bt;
+    bt.setAutoRebalance(2.0);
+    bt.setHashIndex(true);
+    if(!failInserts(bt) || bt.shapeStats().height > 2 * 10 + 1) return false;
+    if(linkedHeight(bt.root<Node<int,Fragile> >(), (Node<int,Fragile>*)NULL) < 0) return false;
+    Inspect<AVLTree<int,Fragile> > at;
+    at.setBloomFilter(8);
+    if(!failInserts(at) || avlHeight(at.root<AVLNode<int,Fragile> >(), (AVLNode<int,Fragile>*)NULL) < 0) return false;
+    Inspect<RedBlackTree<int,Fragile> > rt;
+    if(!failInserts(rt)) return false;
+    return blackHeight(rt.root<RBNode<int,Fragile> >(), (RBNode<int,Fragile>*)NULL) >= 0;
+}
+
+bool testExport()
+{
+    AVLTree<int,int> at;
+    std::ostringstream none;
+    at.exportJson(none);
+    if(none.str() != "null\n") return false;
+    at.insert(std::make_pair(2, 20));
+    at.insert(std::make_pair(1, 10));
+    at.insert(std::make_pair(3, 30));
+    at.insert(std::make_pair(4, 40));
+    std::ostringstream json;
+    at.exportJson(json);
+    if(json.str() != "{\"key\":2,\"value\":20,\"balance\":-1,"
+                     "\"left\":{\"key\":1,\"value\":10,\"balance\":0,\"left\":null,\"right\":null},"
+                     "\"right\":{\"key\":3,\"value\":30,\"balance\":-1,\"left\":null,"
+                     "\"right\":{\"key\":4,\"value\":40,\"balance\":0,\"left\":null,\"right\":null}}}\n") return false;
+
+    BinarySearchTree<std::string,char> bt;
+    bt.insert(std::make_pair(std::string("say \"hi\"\\"), 'x'));
+    std::ostringstream quoted;
+    bt.exportJson(quoted);
+    if(quoted.str() != "{\"key\":\"say \\\"hi\\\"\\\\\",\"value\":120,\"left\":null,\"right\":null}\n") return false;
+
+    // a degenerate chain; the export walks it without recursing
+    BinarySearchTree<int,int> chain;
+    for(int i = 0; i < 10000; i++) chain.insert(std::make_pair(i, i));
+    std::ostringstream dot;
+    chain.exportDot(dot);
+    std::string text = dot.str();
+    size_t nodes = 0, edges = 0;
+    for(size_t pos = 0; (pos = text.find("[label=", pos)) != std::string::npos; pos++) {
+        if(text.compare(pos + 7, 2, "R]") == 0 || text.compare(pos + 7, 2, "L]") == 0) edges++;
+        else nodes++;
+    }
+    if(nodes != 10000 || edges != 9999 || text.compare(0, 13, "digraph bst {") != 0) return false;
+
+    RedBlackTree<int,int> rt;
+    for(int i = 0; i < 10; i++) rt.insert(std::make_pair(i, i));
+    std::ostringstream colors;
+    rt.exportDot(colors);
+    return colors.str().find("\\nblack") != std::string::npos && colors.str().find("\\nred") != std::string::npos;
+}
+
+// Random inserts and removes, then both scan directions must match the
+// reference; hinted inserts and node handles must keep the threads too.
+bool testThreaded()
+{
+    Inspect<ThreadedAVLTree<int,int> > tt;
+    map<int,int> ref;
+    srand(7);
+    for(int i = 0; i < 20000; i++) {
+        int k = rand() % 3000;
+        if(rand() % 3 == 0) {
+            tt.remove(k);
+            ref.erase(k);
+        }
+        else {
+            tt.insert(std::make_pair(k, i));
+            ref[k] = i;
+        }
+    }
+    if(!sameContents(tt, ref) || avlHeight(tt.root<AVLNode<int,int> >(), (AVLNode<int,int>*)NULL) < 0) return false;
+    map<int,int>::reverse_iterator r = ref.rbegin();
+    for(ThreadedAVLTree<int,int>::iterator it = tt.last(); it != tt.end(); --it, ++r) {
+        if(r == ref.rend() || it->first != r->first) return false;
+    }
+    if(r != ref.rend()) return false;
+    ThreadedAVLTree<int,int>::iterator first = tt.begin();
+    if(--first != tt.end()) return false;
+
+    Inspect<ThreadedAVLTree<int,int> > hinted, t1, t2;
+    map<int,int> ref2, r1, r2;
+    if(!hintedInserts(hinted, ref2) || !moveNodes(t1, t2, r1, r2)) return false;
+    if(avlHeight(t2.root<AVLNode<int,int> >(), (AVLNode<int,int>*)NULL) < 0) return false;
+
+    // a hinted insert hands back an iterator that can step backward
+    typedef ThreadedAVLTree<int,int>::iterator Threaded;
+    static_assert(std::is_same<decltype(tt.insert(std::declval<Threaded>(), std::make_pair(0, 0))), Threaded>::value,
+                  "hinted insert returns the threaded iterator");
+    Threaded below = tt.insert(tt.find(ref.begin()->first), std::make_pair(ref.begin()->first - 1, -1));
+    if(below->first != ref.begin()->first - 1 || --below != tt.end()) return false;
+    Threaded above = tt.insert(tt.last(), std::make_pair(ref.rbegin()->first + 1, -1));
+    return (--above)->first == ref.rbegin()->first;
+}
+
+// Churns the tree, compacts it in small steps with more churn in between,
+// then checks the contents, the links, and that an undisturbed pass lays
+// the items out in key order at a fixed stride.
+template<typename Tree>
+bool compactChurn(Inspect<Tree>& tree, map<int,int>& ref)
+{
+    srand(43);
+    for(int round = 0; round < 4; round++) {
+        for(int i = 0; i < 5000; i++) {
+            int k = rand() % 4000;
+            if(rand() % 3 == 0) {
+                tree.remove(k);
+                ref.erase(k);
+            }
+            else {
+                tree.insert(std::make_pair(k, i));
+                ref[k] = i;
+            }
+            if(i % 50 == 0) tree.compact(64);
+        }
+        while(!tree.compact(64)) {
+            int k = rand() % 4000;
+            tree.remove(k);
+            ref.erase(k);
+        }
+        if(!sameContents(tree, ref) || tree.size() != ref.size()) return false;
+        if(linkedHeight(tree.template root<Node<int,int> >(), (Node<int,int>*)NULL) < 0) return false;
+    }
+
+    // an uninterrupted pass; the older blocks empty out and are freed
+    if(!tree.compact() || tree.blocks() != 1) return false;
+    const char* prev = NULL;
+    ptrdiff_t stride = 0;
+    for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+        const char* item = (const char*)&*it;
+        if(prev != NULL) {
+            if(stride == 0) stride = item - prev;
+            if(stride <= 0 || item - prev != stride) return false;
+        }
+        prev = item;
+    }
+
+    // a handle taken from a block owns its node like any other
+    typename Tree::node_handle nh = tree.extract(ref.begin()->first);
+    Tree other;
+    if(nh.empty() || !other.insert(std::move(nh)).second || other.size() != 1) return false;
+    ref.erase(ref.begin());
+    tree.clear();
+    return tree.blocks() == 0 && tree.compact();
+}
+
+// A key with no default constructor.
+struct NoDefaultKey
+{
+    explicit NoDefaultKey(int v) : v(v) { }
+    bool operator<(const NoDefaultKey& other) const { return v < other.v; }
+    bool operator==(const NoDefaultKey& other) const { return v == other.v; }
+    int v;
+};
+
+// printRoot() needs the key printable even though nothing here calls it
+std::ostream& operator<<(std::ostream& os, const NoDefaultKey& key)
+{
+    return os << key.v;
+}
+
+bool testCompact()
+{
+    Inspect<BinarySearchTree<int,int> > bt;
+    Inspect<AVLTree<int,int> > at;
+    Inspect<RedBlackTree<int,int> > rt;
+    Inspect<ThreadedAVLTree<int,int> > tt;
+    map<int,int> r1, r2, r3, r4;
+    if(!compactChurn(bt, r1) || !compactChurn(at, r2) || !compactChurn(rt, r3)) return false;
+
+    // the AVL and red-black invariants and the threads must survive too
+    for(int i = 0; i < 3000; i++) {
+        at.insert(std::make_pair(i * 7 % 3000, i));
+        rt.insert(std::make_pair(i * 7 % 3000, i));
+        tt.insert(std::make_pair(i * 7 % 3000, i));
+        r4[i * 7 % 3000] = i;
+    }
+    for(int i = 0; i < 3000; i += 2) {
+        at.remove(i);
+        rt.remove(i);
+        tt.remove(i);
+        r4.erase(i);
+    }
+    while(!at.compact(100) | !rt.compact(100) | !tt.compact(100)) { }
+    if(avlHeight(at.root<AVLNode<int,int> >(), (AVLNode<int,int>*)NULL) < 0) return false;
+    if(blackHeight(rt.root<RBNode<int,int> >(), (RBNode<int,int>*)NULL) < 0) return false;
+    if(avlHeight(tt.root<AVLNode<int,int> >(), (AVLNode<int,int>*)NULL) < 0) return false;
+    map<int,int>::reverse_iterator r = r4.rbegin();
+    for(ThreadedAVLTree<int,int>::iterator it = tt.last(); it != tt.end(); --it, ++r) {
+        if(r == r4.rend() || it->first != r->first) return false;
+    }
+    if(r != r4.rend() || !sameContents(at, r4) || !sameContents(rt, r4) || !sameContents(tt, r4)) return false;
+
+    // keys need not be default constructible to resume a pass
+    Inspect<AVLTree<NoDefaultKey,int> > nt;
+    for(int i = 0; i < 1000; i++) nt.insert(std::make_pair(NoDefaultKey(i * 7 % 1000), i));
+    int steps = 1;
+    while(!nt.compact(100)) steps++;
+    int expect = 0;
+    for(AVLTree<NoDefaultKey,int>::iterator it = nt.begin(); it != nt.end(); ++it) {
+        if(it->first.v != expect++) return false;
+    }
+    return steps == 10 && expect == 1000 && nt.blocks() == 1;
+}
+
+// Churns trees with the hash index on; every lookup path must agree with
+// the reference, including after node handles, compaction and clear().
+template<typename Tree>
+bool hashIndexChurn(Tree& tree, Tree& other)
+{
+    map<int,int> ref;
+    for(int i = 0; i < 500; i++) {
+        tree.insert(std::make_pair(i * 3, i));
+        ref[i * 3] = i;
+    }
+    tree.setHashIndex(true);
+    if(tree.hashIndexBytes() == 0) return false;
+    srand(44);
+    for(int i = 0; i < 20000; i++) {
+        int k = rand() % 3000;
+        switch(rand() % 5) {
+        case 0:
+            tree.remove(k);
+            ref.erase(k);
+            break;
+        case 1: {
+            typename Tree::node_handle nh = tree.extract(k);
+            if(nh.empty() != (ref.count(k) == 0)) return false;
+            if(!nh.empty()) {
+                other.insert(std::move(nh));
+                ref.erase(k);
+            }
+            break;
+        }
+        case 2:
+            tree.insert(std::make_pair(k, i));
+            ref[k] = i;
+            break;
+        default:
+            if((tree.find(k) != tree.end()) != (ref.count(k) == 1)) return false;
+            if(ref.count(k) && tree[k] != ref[k]) return false;
+            break;
+        }
+        if(i % 1000 == 0) tree.compact(200);
+    }
+    for(int k = 0; k < 3000; k++) {
+        if((tree.find(k) != tree.end()) != (ref.count(k) == 1)) return false;
+    }
+    try {
+        tree[-1];
+        return false;
+    }
+    catch(std::out_of_range&) {
+    }
+    if(!sameContents(tree, ref)) return false;
+
+    // handles moved into the other tree are indexed there once it is on
+    other.setHashIndex(true);
+    for(typename Tree::iterator it = other.begin(); it != other.end(); ++it) {
+        if(other.find(it->first) != it) return false;
+    }
+    tree.clear();
+    tree.insert(std::make_pair(7, 7));
+    if(tree.find(7) == tree.end() || tree.find(0) != tree.end()) return false;
+    tree.setHashIndex(false);
+    return tree.hashIndexBytes() == 0 && tree.find(7) != tree.end();
+}
+
+bool testHashIndex()
+{
+    BinarySearchTree<int,int> b1, b2;
+    AVLTree<int,int> a1, a2;
+    RedBlackTree<int,int> r1, r2;
+    ThreadedAVLTree<int,int> t1, t2;
+    return hashIndexChurn(b1, b2) && hashIndexChurn(a1, a2) && hashIndexChurn(r1, r2) && hashIndexChurn(t1, t2);
+}
+
+// A Bloom filter must never hide a present key, through churn, filter
+// rebuilds, node handles and clear(), and should turn most misses away.
+template<typename Tree>
+bool bloomChurn(Tree& tree)
+{
+    map<int,int> ref;
+    tree.setBloomFilter(10);
+    size_t startBytes = tree.bloomFilterBytes();
+    srand(45);
+    for(int i = 0; i < 30000; i++) {
+        int k = rand() % 20000;
+        int op = rand() % 4;
+        if(op == 0) {
+            tree.remove(k);
+            ref.erase(k);
+        }
+        else if(op == 1 && i % 2 == 0) {
+            typename Tree::node_handle nh = tree.extract(k);
+            if(nh.empty() != (ref.count(k) == 0)) return false;
+            ref.erase(k);
+        }
+        else {
+            tree.insert(std::make_pair(k, i));
+            ref[k] = i;
+        }
+    }
+    if(tree.bloomFilterBytes() <= startBytes || !sameContents(tree, ref)) return false;
+    for(int k = 0; k < 20000; k++) {
+        if((tree.find(k) != tree.end()) != (ref.count(k) == 1)) return false;
+    }
+#ifdef BST_STATS
+    tree.resetStats();
+    for(int k = 100000; k < 110000; k++) tree.find(k);
+    if(tree.stats().filtered < 9000) return false;
+#endif
+    tree.clear();
+    tree.insert(std::make_pair(5, 5));
+    if(tree.find(5) == tree.end() || tree.find(6) != tree.end()) return false;
+    tree.setBloomFilter(0);
+    return tree.bloomFilterBytes() == 0 && tree.find(5) != tree.end();
+}
+
+bool testBloomFilter()
+{
+    BinarySearchTree<int,int> bt;
+    AVLTree<int,int> at;
+    RedBlackTree<int,int> rt;
+    AVLTree<int,int> both;
+    both.setHashIndex(true);
+    return bloomChurn(bt) && bloomChurn(at) && bloomChurn(rt) && bloomChurn(both);
+}
+
+// The structural check for each kind of node.
+bool shapeOk(Node<int,int>* root) { return linkedHeight(root, (Node<int,int>*)NULL) >= 0; }
+bool shapeOk(AVLNode<int,int>* root) { return avlHeight(root, (AVLNode<int,int>*)NULL) >= 0; }
+bool shapeOk(RBNode<int,int>* root) { return blackHeight(root, (RBNode<int,int>*)NULL) >= 0; }
+
+// Erases key ranges and iterator ranges of all sizes between inserts,
+// with the hash index and the Bloom filter on, checking the counts, the
+// contents, the structure and every lookup against the reference.
+template<typename NodeT, typename Tree>
+bool rangeChurn(Inspect<Tree>& tree)
+{
+    map<int,int> ref;
+    tree.setHashIndex(true);
+    tree.setBloomFilter(10);
+    srand(46);
+    for(int round = 0; round < 400; round++) {
+        for(int i = 0; i < 60; i++) {
+            int k = rand() % 10000;
+            tree.insert(std::make_pair(k, i));
+            ref[k] = i;
+        }
+        int lo = rand() % 10000;
+        int hi = lo + rand() % (round % 10 == 0 ? 5000 : 200);
+        if(round % 2 == 0) {
+            size_t expect = distance(ref.lower_bound(lo), ref.lower_bound(hi));
+            if(tree.erase(lo, hi) != expect) return false;
+            ref.erase(ref.lower_bound(lo), ref.lower_bound(hi));
+        }
+        else {
+            map<int,int>::iterator first = ref.lower_bound(lo);
+            map<int,int>::iterator last = ref.lower_bound(hi);
+            typename Tree::iterator tfirst = first == ref.end() ? tree.end() : tree.find(first->first);
+            typename Tree::iterator tlast = last == ref.end() || round % 7 == 0 ? tree.end() : tree.find(last->first);
+            if(tlast == tree.end()) last = ref.end();
+            if(tree.erase(tfirst, tlast) != tlast) return false;
+            ref.erase(first, last);
+        }
+        map<int,int>::iterator one = ref.lower_bound(rand() % 10000);
+        if(one != ref.end()) {
+            typename Tree::iterator next = tree.erase(tree.find(one->first));
+            ref.erase(one++);
+            if(one == ref.end() ? next != tree.end() : next == tree.end() || next->first != one->first) return false;
+        }
+        if(tree.size() != ref.size() || !shapeOk(tree.template root<NodeT>())) return false;
+        if(round % 20 == 0 && !sameContents(tree, ref)) return false;
+    }
+    for(int k = 0; k < 15000; k++) {
+        if((tree.find(k) != tree.end()) != (ref.count(k) == 1)) return false;
+    }
+    if(!sameContents(tree, ref) || tree.erase(5000, 5000) != 0 || tree.erase(-10, -1) != 0) return false;
+    tree.erase(tree.begin(), tree.end());
+    tree.insert(std::make_pair(3, 3));
+    return tree.size() == 1 && tree.find(3) != tree.end() && tree.begin()->first == 3;
+}
+
+bool testRangeErase()
+{
+    Inspect<BinarySearchTree<int,int> > bt;
+    Inspect<AVLTree<int,int> > at;
+    Inspect<RedBlackTree<int,int> > rt;
+    Inspect<ThreadedAVLTree<int,int> > tt;
+    if(!rangeChurn<Node<int,int> >(bt) || !rangeChurn<AVLNode<int,int> >(at) || !rangeChurn<RBNode<int,int> >(rt)) return false;
+    if(!rangeChurn<AVLNode<int,int> >(tt)) return false;
+
+    // the threads must skip each cut range, including one at either end
+    map<int,int> ref;
+    for(int i = 0; i < 2000; i++) {
+        tt.insert(std::make_pair(i, i));
+        ref[i] = i;
+    }
+    tt.erase(0, 100);
+    tt.erase(1900, 2000);
+    tt.erase(500, 1200);
+    ref.erase(ref.begin(), ref.lower_bound(100));
+    ref.erase(ref.lower_bound(1900), ref.end());
+    ref.erase(ref.lower_bound(500), ref.lower_bound(1200));
+    map<int,int>::reverse_iterator r = ref.rbegin();
+    for(ThreadedAVLTree<int,int>::iterator it = tt.last(); it != tt.end(); --it, ++r) {
+        if(r == ref.rend() || it->first != r->first) return false;
+    }
+    return r == ref.rend() && sameContents(tt, ref);
+}
+
+// A polynomial hash of the items in key order: associative but not
+// commutative, so it catches aggregates combined out of order.
+struct OrderedHash
+{
+    typedef pair<uint64_t, uint64_t> value_type;    // hash, 31^items
+    static value_type identity() { return make_pair(0, 1); }
+    static value_type combine(const value_type& a, const value_type& b)
+    {
+        return make_pair(a.first * b.second + b.first, a.second * b.second);
+    }
+    static value_type lift(const int& key, const int& value) { return make_pair(key * 1000003ULL + value + 1, 31); }
+};
+
+template<typename Policy>
+typename Policy::value_type refAggregate(const map<int,int>& ref, int lo, int hi)
+{
+    typename Policy::value_type result = Policy::identity();
+    for(map<int,int>::const_iterator it = ref.lower_bound(lo); it != ref.end() && it->first < hi; ++it) {
+        result = Policy::combine(result, Policy::lift(it->first, it->second));
+    }
+    return result;
+}
+
+// Every way of changing the tree must leave the subtree aggregates right.
+bool testAugmented()
+{
+    Inspect<AugmentedAVLTree<int,int,OrderedHash> > ht;
+    AugmentedAVLTree<int,int,SumAggregate<int> > st;
+    AugmentedAVLTree<int,int,MinAggregate<int> > mt;
+    map<int,int> ref;
+    srand(47);
+    for(int i = 0; i < 20000; i++) {
+        int k = rand() % 3000;
+        int v = rand() % 1000 - 500;
+        switch(rand() % 8) {
+        case 0: case 1:
+            ht.remove(k);
+            st.remove(k);
+            mt.remove(k);
+            ref.erase(k);
+            break;
+        case 2: {
+            AugmentedAVLTree<int,int,OrderedHash>::node_handle nh = ht.extract(k);
+            if(!nh.empty()) ht.insert(std::move(nh));
+            break;
+        }
+        case 3:
+            if(i % 50 == 0) {
+                ht.erase(k, k + 100);
+                st.erase(k, k + 100);
+                mt.erase(k, k + 100);
+                ref.erase(ref.lower_bound(k), ref.lower_bound(k + 100));
+            }
+            else {
+                ht.insert(ht.find(k), std::make_pair(k, v));
+                st.insert(std::make_pair(k, v));
+                mt.insert(std::make_pair(k, v));
+                ref[k] = v;
+            }
+            break;
+        default:
+            ht.insert(std::make_pair(k, v));
+            st.insert(std::make_pair(k, v));
+            mt.insert(std::make_pair(k, v));
+            ref[k] = v;
+            break;
+        }
+        if(i % 1000 == 0) ht.compact(300);
+        if(i % 100 == 0) {
+            int lo = rand() % 3000;
+            int hi = lo + rand() % 1500;
+            if(ht.aggregate(lo, hi) != refAggregate<OrderedHash>(ref, lo, hi)) return false;
+            if(st.aggregate(lo, hi) != refAggregate<SumAggregate<int> >(ref, lo, hi)) return false;
+            if(mt.aggregate(lo, hi) != refAggregate<MinAggregate<int> >(ref, lo, hi)) return false;
+        }
+    }
+    if(!sameContents(ht, ref) || avlHeight(ht.root<AVLNode<int,int> >(), (AVLNode<int,int>*)NULL) < 0) return false;
+    if(ht.aggregate() != refAggregate<OrderedHash>(ref, 0, 3000)) return false;
+    for(int lo = -1; lo < 3001; lo += 97) {
+        if(ht.aggregate(lo, lo) != OrderedHash::identity()) return false;
+        if(ht.aggregate(lo, lo + 1) != refAggregate<OrderedHash>(ref, lo, lo + 1)) return false;
+    }
+    ht.clear();
+    return ht.aggregate() == OrderedHash::identity() && ht.aggregate(0, 3000) == OrderedHash::identity();
+}
+
+// Writes to an AugmentedAVLTree through every public path, overwrites
+// and structural changes alike, and checks the aggregates against a
+// brute-force fold after each; iterators and base references must not
+// allow writes at all.
+bool testAugmentedOverwrites()
+{
+    typedef AugmentedAVLTree<int,int,SumAggregate<int> > Tree;
+    typedef decltype((std::declval<Tree::iterator&>()->second)) IterValue;
+    static_assert(std::is_const<std::remove_reference<IterValue>::type>::value, "iterators are const");
+    static_assert(std::is_const<std::remove_reference<decltype(*std::declval<Tree::iterator&>())>::type>::value,
+                  "iterators are const");
+    static_assert(!std::is_same<decltype(std::declval<Tree&>()[0]), int&>::value, "operator[] is not a Value&");
+    static_assert(!std::is_convertible<Tree*, AVLTree<int,int>*>::value, "no AVLTree reference");
+    static_assert(!std::is_convertible<Tree*, BinarySearchTree<int,int>*>::value, "no BinarySearchTree reference");
+    static_assert(!std::is_convertible<IntervalTree<int,int>*, AVLTree<Interval<int>,int>*>::value,
+                  "no AVLTree reference to an IntervalTree");
+
+    Tree tree;
+    map<int,int> ref;
+    for(int i = 0; i < 1000; i++) {
+        tree.insert(std::make_pair(i, i));
+        ref[i] = i;
+    }
+    srand(147);
+    for(int i = 0; i < 11000; i++) {
+        int k = rand() % 1000;
+        int v = rand() % 1000 - 500;
+        int kind = i % 11;
+        // the overwrites need the key present
+        if(kind >= 2 && kind <= 5 && ref.count(k) == 0) {
+            tree.insert(std::make_pair(k, 0));
+            ref[k] = 0;
+        }
+        switch(kind) {
+        case 0:
+            tree.insert(std::make_pair(k, v));
+            ref[k] = v;
+            break;
+        case 1:
+            tree.insert(tree.find(k), std::make_pair(k, v));
+            ref[k] = v;
+            break;
+        case 2:
+            tree[k] = v;
+            ref[k] = v;
+            break;
+        case 3: {
+            // copies the value of another key
+            int other = rand() % 1000;
+            if(ref.count(other) == 0) break;
+            tree[k] = tree[other];
+            ref[k] = ref[other];
+            break;
+        }
+        case 4: {
+            Tree::node_handle nh = tree.extract(k);
+            nh.mapped() = v;
+            if(!tree.insert(std::move(nh)).second) return false;
+            ref[k] = v;
+            break;
+        }
+        case 5: {
+            const Tree& view = tree;
+            v = view[k] + 1;
+            tree[k] = v;
+            ref[k] = v;
+            break;
+        }
+        case 6:
+            tree.remove(k);
+            ref.erase(k);
+            break;
+        case 7:
+            if(tree.find(k) != tree.end()) {
+                Tree::iterator next = tree.erase(tree.find(k));
+                map<int,int>::iterator refNext = ref.erase(ref.find(k));
+                if(refNext == ref.end() ? next != tree.end() : next->first != refNext->first) return false;
+            }
+            break;
+        case 8:
+            if(tree.erase(k, k + 5) != (size_t)std::distance(ref.lower_bound(k), ref.lower_bound(k + 5))) return false;
+            ref.erase(ref.lower_bound(k), ref.lower_bound(k + 5));
+            break;
+        case 9: {
+            Tree::iterator first = tree.find(k);
+            if(first == tree.end()) break;
+            Tree::iterator last = first;
+            map<int,int>::iterator refLast = ref.find(k);
+            for(int j = 0; j < 3 && last != tree.end(); j++, ++refLast) ++last;
+            tree.erase(first, last);
+            ref.erase(ref.find(k), refLast);
+            break;
+        }
+        default:
+            tree.compact(50);
+            break;
+        }
+        if(tree.size() != ref.size()) return false;
+        if(ref.count(k) != 0 && (tree[k] != ref[k] || tree.find(k)->second != ref[k])) return false;
+        if(tree.aggregate() != refAggregate<SumAggregate<int> >(ref, 0, 1000)) return false;
+        int lo = rand() % 1000;
+        if(tree.aggregate(lo, lo + 100) != refAggregate<SumAggregate<int> >(ref, lo, lo + 100)) return false;
+    }
+    try {
+        tree[5000] = 1;
+        return false;
+    }
+    catch(std::out_of_range&) {
+    }
+    return sameContents(tree, ref);
+}
+
+// Checks that a query returned exactly the intervals of ref that match,
+// in key order.
+template<typename Match>
+bool sameIntervals(const vector<IntervalTree<int,int>::iterator>& found,
+                   const map<Interval<int>,int>& ref, Match match)
+{
+    size_t i = 0;
+    for(map<Interval<int>,int>::const_iterator it = ref.begin(); it != ref.end(); ++it) {
+        if(!match(it->first)) continue;
+        if(i == found.size() || !(found[i]->first == it->first) || found[i]->second != it->second) return false;
+        i++;
+    }
+    return i == found.size();
+}
+
+// Stabbing and overlap queries against a brute-force scan, with many
+// intervals sharing a start and some far longer than the rest.
+bool testIntervals()
+{
+    Inspect<IntervalTree<int,int> > tree;
+    map<Interval<int>,int> ref;
+    srand(48);
+    for(int i = 0; i < 6000; i++) {
+        int start = rand() % 2000;
+        int length = rand() % 20 == 0 ? rand() % 800 + 1 : rand() % 30 + 1;
+        Interval<int> interval(start, start + length);
+        if(rand() % 4 == 0) {
+            tree.remove(interval);
+            ref.erase(interval);
+            if(!ref.empty()) {
+                map<Interval<int>,int>::iterator it = ref.lower_bound(interval);
+                if(it == ref.end()) --it;
+                tree.remove(it->first);
+                ref.erase(it);
+            }
+        }
+        else {
+            tree.insert(std::make_pair(interval, i));
+            ref[interval] = i;
+        }
+    }
+    if(tree.size() != ref.size() || avlHeight(tree.root<AVLNode<Interval<int>,int> >(), (AVLNode<Interval<int>,int>*)NULL) < 0) return false;
+    for(int q = 0; q < 500; q++) {
+        int p = rand() % 3000 - 100;
+        vector<IntervalTree<int,int>::iterator> found;
+        tree.stab(p, found);
+        if(!sameIntervals(found, ref, [p](const Interval<int>& iv) { return iv.start <= p && p < iv.end; })) return false;
+        int lo = rand() % 3000 - 100;
+        int hi = lo + rand() % 100;
+        found.clear();
+        tree.overlapping(lo, hi, found);
+        if(!sameIntervals(found, ref, [lo, hi](const Interval<int>& iv) { return lo < hi && iv.start < hi && lo < iv.end; })) return false;
+    }
+    return true;
+}
+
+template<typename Tree>
+string jsonOf(const Tree& tree)
+{
+    ostringstream os;
+    tree.exportJson(os);
+    return os.str();
+}
+
+// A copy must have the same shape, balances and colors as the original
+// and share nothing with it, including the index, the filter and any
+// compacted nodes; moves and swaps must not allocate.
+template<typename NodeT, typename Tree>
+bool copyAndMove(bool indexed)
+{
+    Inspect<Tree> tree;
+    map<int,int> ref;
+    if(indexed) {
+        tree.setHashIndex(true);
+        tree.setBloomFilter(10);
+    }
+    srand(49);
+    for(int i = 0; i < 4000; i++) {
+        int k = rand() % 3000;
+        if(rand() % 4 == 0) {
+            tree.remove(k);
+            ref.erase(k);
+        }
+        else {
+            tree.insert(std::make_pair(k, i));
+            ref[k] = i;
+        }
+        if(i == 3000) tree.compact();
+    }
+
+    Inspect<Tree> copy(tree);
+    if(jsonOf(copy) != jsonOf(tree) || copy.size() != tree.size() || copy.blocks() != 0) return false;
+    if(!shapeOk(copy.template root<NodeT>()) || !sameContents(copy, ref)) return false;
+    for(int k = 0; k < 3000; k++) {
+        if((copy.find(k) != copy.end()) != (ref.count(k) == 1)) return false;
+    }
+    map<int,int> original = ref;
+    for(int k = 0; k < 3000; k += 3) {
+        copy.remove(k);
+        ref.erase(k);
+    }
+    copy.insert(std::make_pair(5000, 1));
+    ref[5000] = 1;
+    if(!sameContents(tree, original) || !sameContents(copy, ref)) return false;
+
+    // assignment replaces what was there; self-assignment changes nothing
+    Inspect<Tree> assigned;
+    assigned.insert(std::make_pair(-1, -1));
+    assigned = tree;
+    const Inspect<Tree>& self = assigned;
+    assigned = self;
+    if(jsonOf(assigned) != jsonOf(tree) || !sameContents(assigned, original)) return false;
+
+    size_t before = allocations;
+    Inspect<Tree> moved(std::move(copy));
+    assigned = std::move(moved);
+    tree.swap(assigned);
+    if(allocations != before) return false;
+    if(!copy.empty() || copy.size() != 0 || !moved.empty() || copy.begin() != copy.end()) return false;
+    if(!sameContents(tree, ref) || !sameContents(assigned, original) || tree.find(5000) == tree.end()) return false;
+    if(!shapeOk(tree.template root<NodeT>()) || !shapeOk(assigned.template root<NodeT>())) return false;
+    copy.insert(std::make_pair(1, 1));
+    return copy.size() == 1 && copy.find(1) != copy.end();
+}
+
+bool testCopyMove()
+{
+    if(!copyAndMove<Node<int,int>, BinarySearchTree<int,int> >(false)) return false;
+    if(!copyAndMove<AVLNode<int,int>, AVLTree<int,int> >(true)) return false;
+    if(!copyAndMove<RBNode<int,int>, RedBlackTree<int,int> >(true)) return false;
+    if(!copyAndMove<AVLNode<int,int>, ThreadedAVLTree<int,int> >(false)) return false;
+
+    // the copy's threads and aggregates are its own
+    ThreadedAVLTree<int,int> threaded;
+    AugmentedAVLTree<int,int,SumAggregate<int> > summed;
+    for(int i = 0; i < 1000; i++) {
+        threaded.insert(std::make_pair(i, i));
+        summed.insert(std::make_pair(i, i));
+    }
+    ThreadedAVLTree<int,int> threadedCopy(threaded);
+    AugmentedAVLTree<int,int,SumAggregate<int> > summedCopy(summed);
+    threaded.clear();
+    summed.erase(0, 500);
+    int expect = 0;
+    for(ThreadedAVLTree<int,int>::iterator it = threadedCopy.last(); it != threadedCopy.end(); --it) {
+        if(it->first != 999 - expect++) return false;
+    }
+    return expect == 1000 && summedCopy.aggregate(100, 200) == 14950 && summed.aggregate() == 374750;
+}
+
+// True if a.swap(b) compiles for an A a and a B b.
+template<typename A, typename B>
+struct MemberSwaps
+{
+    template<typename T>
+    static char test(decltype(std::declval<T&>().swap(std::declval<B&>()))*);
+    template<typename T>
+    static long test(...);
+    static const bool value = sizeof(test<A>(0)) == 1;
+};
+
+// True if swap(a, b) compiles for an A a and a B b.
+template<typename A, typename B>
+struct FreeSwaps
+{
+    template<typename T>
+    static char test(decltype(swap(std::declval<T&>(), std::declval<B&>()))*);
+    template<typename T>
+    static long test(...);
+    static const bool value = sizeof(test<A>(0)) == 1;
+};
+
+// Only trees of the same type swap; a threaded tree keeps its threads.
+bool testSwap()
+{
+    typedef BinarySearchTree<int,int> Plain;
+    typedef AugmentedAVLTree<Interval<int>,int,MaxEndAggregate<int> > MaxEnds;
+    static_assert(MemberSwaps<AVLTree<int,int>, AVLTree<int,int> >::value, "same type");
+    static_assert(!MemberSwaps<AVLTree<int,int>, RedBlackTree<int,int> >::value, "AVL with RB");
+    static_assert(!MemberSwaps<RedBlackTree<int,int>, Plain>::value, "RB with BST");
+    static_assert(!MemberSwaps<ThreadedAVLTree<int,int>, AVLTree<int,int> >::value, "threaded with AVL");
+    static_assert(!MemberSwaps<IntervalTree<int,int>, MaxEnds>::value, "interval with augmented");
+    static_assert(FreeSwaps<Plain, Plain>::value && FreeSwaps<RedBlackTree<int,int>, RedBlackTree<int,int> >::value,
+                  "same type");
+    static_assert(FreeSwaps<IntervalTree<int,int>, IntervalTree<int,int> >::value, "same type");
+    static_assert(!FreeSwaps<AVLTree<int,int>, RedBlackTree<int,int> >::value, "AVL with RB");
+    static_assert(!FreeSwaps<Plain, AVLTree<int,int> >::value, "BST with AVL");
+    static_assert(!FreeSwaps<ThreadedAVLTree<int,int>, AVLTree<int,int> >::value, "threaded with AVL");
+    static_assert(!FreeSwaps<MaxEnds, IntervalTree<int,int> >::value, "augmented with interval");
+
+    // through base references only the run-time check is left
+    AVLTree<int,int> avl;
+    RedBlackTree<int,int> rb;
+    avl.insert(std::make_pair(1, 1));
+    Plain& base = avl;
+    try {
+        base.swap(rb);
+        return false;
+    }
+    catch(std::invalid_argument&) {
+    }
+    if(avl.size() != 1 || !rb.empty()) return false;
+
+    ThreadedAVLTree<int,int> t1, t2;
+    for(int i = 0; i < 100; i++) {
+        t1.insert(std::make_pair(i, i));
+        t2.insert(std::make_pair(1000 + i, i));
+    }
+    swap(t1, t2);
+    t1.swap(t2);
+    t1.swap(t2);
+    int up = 0, down = 0;
+    for(ThreadedAVLTree<int,int>::iterator it = t1.begin(); it != t1.end(); ++it) {
+        if(it->first != 1000 + up++) return false;
+    }
+    for(ThreadedAVLTree<int,int>::iterator it = t2.last(); it != t2.end(); --it) {
+        if(it->first != 99 - down++) return false;
+    }
+
+    Plain p1, p2;
+    p1.insert(std::make_pair(1, 1));
+    swap(p1, p2);
+    return up == 100 && down == 100 && p1.empty() && p2.size() == 1;
+}
+
+// Records a few operations through each anonymization mode and checks
+// the trace decodes to the same operations with keys mapped one-to-one.
+bool testTrace()
+{
+    const TraceAnonymize modes[] = { ANONYMIZE_NONE, ANONYMIZE_SHIFT, ANONYMIZE_HASH };
+    for(int m = 0; m < 3; m++) {
+        std::stringstream trace;
+        AVLTree<uint64_t,int> at;
+        TraceRecorder<AVLTree<uint64_t,int> > rec(at, trace, modes[m], 12345);
+        for(uint64_t k = 0; k < 100; k++) rec.insert(std::make_pair(k * 7 % 101, 1));
+        if(rec.find(14) == rec.end() || rec.find(1000) != rec.end()) return false;
+        rec.remove(14);
+        int seen = 0;
+        rec.iterate([&](const std::pair<const uint64_t,int>&) { seen++; });
+        rec.iterateFrom(50, 10, [&](const std::pair<const uint64_t,int>&) { seen++; });
+        if(seen != 99 + 10 || rec.records() != 105) return false;
+
+        TraceReader reader(trace);
+        if(!reader.valid()) return false;
+        std::map<uint64_t,uint64_t> keyMap;   // original -> recorded
+        std::map<uint64_t,uint64_t> inverse;
+        TraceOp op;
+        std::vector<TraceOp> ops;
+        while(reader.next(op)) ops.push_back(op);
+        if(ops.size() != 105) return false;
+        for(size_t i = 0; i < ops.size(); i++) {
+            uint64_t orig = i < 100 ? i * 7 % 101 : (i == 100 || i == 102) ? 14 : i == 101 ? 1000 : 50;
+            uint8_t expected = i < 100 ? TRACE_INSERT : i < 102 ? TRACE_FIND : i == 102 ? TRACE_REMOVE : TRACE_ITERATE;
+            if(ops[i].opcode != expected) return false;
+            if(i == 103) {
+                if(!ops[i].fromBegin || ops[i].steps != 99) return false;
+                continue;
+            }
+            if(ops[i].fromBegin) return false;
+            if(i == 104 && ops[i].steps != 10) return false;
+            if(keyMap.count(orig) && keyMap[orig] != ops[i].key) return false;
+            if(inverse.count(ops[i].key) && inverse[ops[i].key] != orig) return false;
+            keyMap[orig] = ops[i].key;
+            inverse[ops[i].key] = orig;
+            if(modes[m] == ANONYMIZE_NONE && ops[i].key != orig) return false;
+            if(modes[m] == ANONYMIZE_SHIFT && ops[i].key != orig + 12345) return false;
+        }
+    }
+    std::stringstream junk("not a trace");
+    TraceReader bad(junk);
+    return !bad.valid();
+}
+
+// Reads back the keys of a trace of updates.
+std::vector<uint64_t> tracedKeys(std::stringstream& trace)
+{
+    std::vector<uint64_t> keys;
+    TraceReader reader(trace);
+    TraceOp op;
+    while(reader.next(op)) keys.push_back(op.key);
+    return keys;
+}
+
+// Negative and near-maximum keys keep their order in the recorded keys,
+// and a shift that would wrap a key is refused before the tree changes.
+bool testTraceKeyOrder()
+{
+    const int64_t signedKeys[] = { INT64_MIN, -1000, -1, 0, 1, 1000, INT64_MAX - 1, INT64_MAX };
+    const TraceAnonymize modes[] = { ANONYMIZE_NONE, ANONYMIZE_SHIFT };
+    for(int m = 0; m < 2; m++) {
+        std::stringstream trace;
+        AVLTree<int64_t,int> at;
+        TraceRecorder<AVLTree<int64_t,int> > rec(at, trace, modes[m], m == 0 ? 0 : 1);
+        bool threw = false;
+        for(int i = 0; i < 8; i++) {
+            try {
+                rec.insert(std::make_pair(signedKeys[i], i));
+            }
+            catch(std::overflow_error&) {
+                threw = true;
+            }
+        }
+        // a shift of 1 has room for every key but INT64_MAX
+        if(threw != (m == 1) || at.size() != (m == 1 ? 7u : 8u)) return false;
+        std::vector<uint64_t> keys = tracedKeys(trace);
+        if(keys.size() != at.size()) return false;
+        for(size_t i = 1; i < keys.size(); i++) {
+            if(!(keys[i - 1] < keys[i])) return false;
+        }
+    }
+
+    const uint64_t big[] = { 0, UINT64_MAX - 300, UINT64_MAX - 200, UINT64_MAX - 100, UINT64_MAX };
+    std::stringstream trace;
+    AVLTree<uint64_t,int> ut;
+    TraceRecorder<AVLTree<uint64_t,int> > rec(ut, trace, ANONYMIZE_SHIFT, 150);
+    for(int i = 0; i < 5; i++) {
+        try {
+            rec.insert(std::make_pair(big[i], i));
+        }
+        catch(std::overflow_error&) {
+            if(i < 3) return false;
+        }
+    }
+    try {
+        rec.remove(UINT64_MAX);
+        return false;
+    }
+    catch(std::overflow_error&) {
+    }
+    std::vector<uint64_t> keys = tracedKeys(trace);
+    return ut.size() == 3 && rec.records() == 3 && keys.size() == 3 &&
+           keys[0] == 150 && keys[1] == UINT64_MAX - 150 && keys[2] == UINT64_MAX - 50;
+}
 
 int main(int argc, char *argv[])
 {
@@ -44,5 +1533,114 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
-    return 0;
+    // Red-Black Tree Tests
+    RedBlackTree<char,int> rt;
+    rt.insert(std::make_pair('a',1));
+    rt.insert(std::make_pair('b',2));
+
+    cout << "\nRedBlackTree contents:" << endl;
+    for(RedBlackTree<char,int>::iterator it = rt.begin(); it != rt.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    cout << "Erasing b" << endl;
+    rt.remove('b');
+
+    bool ok = true;
+    bool res = testRedBlackChurn();
+    cout << "RedBlackTree churn: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testHintedInsert();
+    cout << "Hinted insert/find: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testAVLAllocations();
+    cout << "AVLTree allocations: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testNodeHandles();
+    cout << "Node handles: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testStats();
+    cout << "Operation stats: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testKeyPaths();
+    cout << "Integral/generic descent: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testPrefixedString();
+    cout << "Prefixed string keys: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testFindBatch();
+    cout << "Batched find: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testShapeStats();
+    cout << "Shape stats: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testRebalance();
+    cout << "Rebalance: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testThrowingInsert();
+    cout << "Throwing insert: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testExport();
+    cout << "DOT/JSON export: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testThreaded();
+    cout << "Threaded AVLTree: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testCompact();
+    cout << "Compaction: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testHashIndex();
+    cout << "Hash index: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testBloomFilter();
+    cout << "Bloom filter: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testRangeErase();
+    cout << "Range erase: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testAugmented();
+    cout << "Augmented AVLTree: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testAugmentedOverwrites();
+    cout << "Augmented AVLTree overwrites: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testIntervals();
+    cout << "Interval tree: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testCopyMove();
+    cout << "Copy and move: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testSwap();
+    cout << "Swap: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testTrace();
+    cout << "Trace record/decode: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    res = testTraceKeyOrder();
+    cout << "Trace key order: " << (res ? "passed" : "FAILED") << endl;
+    ok = ok && res;
+
+    return ok ? 0 : 1;
 }
@@ -4,7 +4,21 @@
 #include <iostream>
 #include <exception>
 #include <cstdlib>
+#include <cmath>
 #include <utility>
+#include <vector>
+#include <type_traits>
+#include <sstream>
+#include <string>
+#include <new>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <typeinfo>
+
+#include "bst_stats.h"
+#include "bst_hash_index.h"
+#include "bst_bloom.h"
 
 /**
  * A templated class for a Node in a search tree.
@@ -29,6 +43,9 @@ public:
     virtual Node<Key, Value>* getParent() const;
     virtual Node<Key, Value>* getLeft() const;
     virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getChild(bool right) const;
+    virtual size_t nodeSize() const;
+    virtual Node<Key, Value>* copyTo(void* where) const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
@@ -144,6 +161,39 @@ Node<Key, Value>* Node<Key, Value>::getRight() const
     return right_;
 }
 
+/**
+* Returns the right child if right is true, else the left one. Not
+* virtual, and picks the child by indexing rather than branching, for
+* the branchless descent in BinarySearchTree::descend().
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* Node<Key, Value>::getChild(bool right) const
+{
+    Node<Key, Value>* const children[2] = { left_, right_ };
+    return children[right];
+}
+
+/**
+* The size of the node's most derived type, for code that places nodes
+* in memory it manages itself.
+*/
+template<typename Key, typename Value>
+size_t Node<Key, Value>::nodeSize() const
+{
+    return sizeof(Node<Key, Value>);
+}
+
+/**
+* Copy-constructs this node, links included, into where, which must
+* have room for nodeSize() bytes. Node types with more members
+* override both of these.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* Node<Key, Value>::copyTo(void* where) const
+{
+    return new (where) Node<Key, Value>(*this);
+}
+
 /**
 * A setter for setting the parent of a node.
 */
@@ -186,6 +236,40 @@ void Node<Key, Value>::setValue(const Value& value)
   ---------------------------------------
 */
 
+template <typename Key, typename Value>
+class BinarySearchTree;
+
+/**
+* Owns a node that was extracted from a tree, so it can be inserted
+* into another tree of the same type without reallocating it or
+* copying its item. Destroying a non-empty handle frees the node.
+* NodeT is the node type the tree makes; each tree has its own
+* node_handle, so a node cannot be moved into a tree of another kind.
+*/
+template <typename Key, typename Value, typename NodeT>
+class NodeHandle
+{
+public:
+    typedef NodeT node_type;
+
+    NodeHandle();
+    NodeHandle(NodeHandle&& other);
+    NodeHandle& operator=(NodeHandle&& other);
+    ~NodeHandle();
+
+    bool empty() const;
+    explicit operator bool() const;
+    const Key& key() const;
+    Value& mapped() const;
+
+protected:
+    friend class BinarySearchTree<Key, Value>;
+    explicit NodeHandle(NodeT* node);
+    NodeHandle(const NodeHandle&);
+    NodeHandle& operator=(const NodeHandle&);
+    NodeT* node_;
+};
+
 /**
 * A templated unbalanced binary search tree.
 */
@@ -193,14 +277,37 @@ template <typename Key, typename Value>
 class BinarySearchTree
 {
 public:
+    typedef Key key_type;
+    typedef Value mapped_type;
+
     BinarySearchTree(); //TODO
+    BinarySearchTree(const BinarySearchTree& other);
+    BinarySearchTree(BinarySearchTree&& other);
     virtual ~BinarySearchTree(); //TODO
+    BinarySearchTree& operator=(const BinarySearchTree& other);
+    BinarySearchTree& operator=(BinarySearchTree&& other);
+    void swap(BinarySearchTree& other);
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
+    size_t erase(const Key& lo, const Key& hi);
     void clear(); //TODO
     bool isBalanced() const; //TODO
     void print() const;
+    void exportDot(std::ostream& os) const;
+    void exportJson(std::ostream& os) const;
     bool empty() const;
+    size_t rotations() const;
+    BSTStats stats() const;
+    void resetStats();
+    ShapeStats shapeStats() const;
+    size_t size() const;
+    virtual void rebalance();
+    void setAutoRebalance(double c);
+    bool compact(size_t maxNodes = (size_t)-1);
+    void setHashIndex(bool on);
+    size_t hashIndexBytes() const;
+    void setBloomFilter(double bitsPerKey, double staleFraction = 0.25);
+    size_t bloomFilterBytes() const;
 
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
@@ -227,23 +334,90 @@ public:
         Node<Key, Value> *current_;
     };
 
+public:
+    typedef NodeHandle<Key, Value, Node<Key, Value> > node_handle;
+
 public:
     iterator begin() const;
     iterator end() const;
     iterator find(const Key& key) const;
+    iterator find(iterator hint, const Key& key) const;
+    void findBatch(const std::vector<Key>& keys, std::vector<iterator>& out) const;
+    virtual iterator insert(iterator hint, const std::pair<const Key, Value>& keyValuePair);
+    iterator erase(iterator pos);
+    iterator erase(iterator first, iterator last);
+    node_handle extract(const Key& key);
+    std::pair<iterator, bool> insert(node_handle&& nh);
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
 protected:
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    Node<Key, Value>* internalFind(const Key& k, Node<Key, Value>* start) const;
+    Node<Key, Value>* findFrom(const Key& k, Node<Key, Value>* start, std::false_type) const;
+    Node<Key, Value>* findFrom(const Key& k, Node<Key, Value>* start, std::true_type) const;
+    Node<Key, Value>* descend(const Key& k, Node<Key, Value>* start, Node<Key, Value>*& parent) const;
+    Node<Key, Value>* descend(const Key& k, Node<Key, Value>* start, Node<Key, Value>*& parent, std::false_type) const;
+    Node<Key, Value>* descend(const Key& k, Node<Key, Value>* start, Node<Key, Value>*& parent, std::true_type) const;
+    Node<Key, Value>* fingerStart(const iterator& hint, const Key& k) const;
+    static iterator iteratorAt(Node<Key, Value>* node);
+    Node<Key, Value>* extractNode(const Key& key);
+    virtual std::pair<iterator, bool> adopt(Node<Key, Value>* node);
+    virtual const std::type_info& nodeType() const;
+    template<typename Handle>
+    Handle extractHandle(const Key& key);
+    template<typename Handle>
+    std::pair<iterator, bool> insertHandle(Handle& nh);
+    virtual Node<Key, Value>* detach(Node<Key, Value>* node);
+    void rotateUp(Node<Key, Value>* node);
+    Node<Key, Value>* rebuild(Node<Key, Value>* top);
+    void checkDepth(Node<Key, Value>* inserted);
+    static size_t subtreeSize(Node<Key, Value>* top);
+    template<typename NodeT>
+    NodeT* createNode(const Key& key, const Value& value, NodeT* parent);
+    void freeNode(Node<Key, Value>* node);
+    void releaseNode(Node<Key, Value>* node);
+    virtual void relink(Node<Key, Value>* old, Node<Key, Value>* copy);
+    Node<Key, Value>* firstAfter(const Key& k) const;
+    Node<Key, Value>* lowerBound(const Key& k) const;
+    virtual Node<Key, Value>* cutRange(const Key& lo, const Key* hi);
+    static void splitAt(Node<Key, Value>* top, const Key& k, Node<Key, Value>*& less, Node<Key, Value>*& rest);
+    void freeSubtree(Node<Key, Value>* top);
+    void copyNodes(const BinarySearchTree& other);
+    struct CompactBlock
+    {
+        char* start;
+        char* end;
+        size_t live;    // nodes constructed in it and not yet destroyed
+    };
+    CompactBlock* compactBlock(const void* p);
+    void freeBlock(CompactBlock& block);
+    void endCompaction();
+    void indexNode(Node<Key, Value>* node);
+    void unindexNode(Node<Key, Value>* node);
+    void rebuildBloomFilter();
+    template<typename K>
+    static size_t hashKey(const K& key);
     Node<Key, Value> *getSmallestNode() const;  // TODO
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
+    static Node<Key, Value>* successor(Node<Key, Value>* current);
+    void swapTrees(BinarySearchTree& other);
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
 
     // Provided helper functions
     virtual void printRoot (Node<Key, Value> *r) const;
+    virtual void exportFields(std::ostream& os, Node<Key, Value>* node, bool json) const;
+    void exportTree(std::ostream& os, bool json) const;
+    template<typename T>
+    static void writeJsonScalar(std::ostream& os, const T& value, std::ostringstream& scratch);
+    template<typename T>
+    static void writeJsonScalar(std::ostream& os, const T& value, std::ostringstream& scratch, std::true_type);
+    template<typename T>
+    static void writeJsonScalar(std::ostream& os, const T& value, std::ostringstream& scratch, std::false_type);
+    template<typename T>
+    static void writeEscaped(std::ostream& os, const T& value, std::ostringstream& scratch);
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
 
     // Add helper functions here
@@ -256,6 +430,24 @@ protected:
 protected:
     Node<Key, Value>* root_;
     // You should not need other data members
+    size_t rotations_;  // maintained by the balancing trees
+    size_t size_;
+    double autoRebalance_;  // 0 when off, else the c of setAutoRebalance()
+    // compact() state: the blocks holding relocated nodes, sorted by
+    // address, and the pass in progress, if any. A freed block stays in
+    // blocks_, empty (start == end), until the next pass sweeps it out.
+    std::vector<CompactBlock> blocks_;
+    char* compactFill_;     // next free slot, or null between passes
+    char* compactEnd_;
+    char* compactStart_;
+    size_t compactSlot_;
+    Key* compactAfter_;     // the last key a pass reached, or null
+                            // before its first step
+    NodeHashIndex<Key, Node<Key, Value> > hashIndex_;     // see setHashIndex()
+    KeyBloomFilter<Key> bloom_;     // see setBloomFilter()
+#ifdef BST_STATS
+    mutable BSTStats stats_;
+#endif
 };
 
 /*
@@ -370,6 +562,102 @@ End implementations for the BinarySearchTree::iterator class.
 -------------------------------------------------------------
 */
 
+/*
+-----------------------------------------------------
+Begin implementations for the NodeHandle class.
+-----------------------------------------------------
+*/
+
+/**
+* A default constructor for an empty handle.
+*/
+template<class Key, class Value, class NodeT>
+NodeHandle<Key, Value, NodeT>::NodeHandle() : node_(nullptr)
+{
+
+}
+
+/**
+* Takes ownership of a node that is no longer linked into a tree.
+*/
+template<class Key, class Value, class NodeT>
+NodeHandle<Key, Value, NodeT>::NodeHandle(NodeT* node) : node_(node)
+{
+
+}
+
+/**
+* Move constructor; other is left empty.
+*/
+template<class Key, class Value, class NodeT>
+NodeHandle<Key, Value, NodeT>::NodeHandle(NodeHandle&& other) : node_(other.node_)
+{
+    other.node_ = nullptr;
+}
+
+/**
+* Move assignment; frees the node this handle owned, if any.
+*/
+template<class Key, class Value, class NodeT>
+NodeHandle<Key, Value, NodeT>&
+NodeHandle<Key, Value, NodeT>::operator=(NodeHandle&& other)
+{
+    if (this != &other) {
+        delete node_;
+        node_ = other.node_;
+        other.node_ = nullptr;
+    }
+    return *this;
+}
+
+/**
+* Frees the owned node, if any.
+*/
+template<class Key, class Value, class NodeT>
+NodeHandle<Key, Value, NodeT>::~NodeHandle()
+{
+    delete node_;
+}
+
+/**
+* Returns true if the handle owns no node.
+*/
+template<class Key, class Value, class NodeT>
+bool NodeHandle<Key, Value, NodeT>::empty() const
+{
+    return node_ == nullptr;
+}
+
+template<class Key, class Value, class NodeT>
+NodeHandle<Key, Value, NodeT>::operator bool() const
+{
+    return node_ != nullptr;
+}
+
+/**
+* @precondition The handle is not empty
+*/
+template<class Key, class Value, class NodeT>
+const Key& NodeHandle<Key, Value, NodeT>::key() const
+{
+    return node_->getKey();
+}
+
+/**
+* @precondition The handle is not empty
+*/
+template<class Key, class Value, class NodeT>
+Value& NodeHandle<Key, Value, NodeT>::mapped() const
+{
+    return node_->getValue();
+}
+
+/*
+---------------------------------------------------------------
+End implementations for the NodeHandle class.
+---------------------------------------------------
+*/
+
 /*
 -----------------------------------------------------
 Begin implementations for the BinarySearchTree class.
@@ -384,9 +672,114 @@ BinarySearchTree<Key, Value>::BinarySearchTree()
 {
     // TODO
     root_=nullptr;
+    rotations_=0;
+    size_=0;
+    autoRebalance_=0;
+    compactFill_=nullptr;
+    compactEnd_=nullptr;
+    compactStart_=nullptr;
+    compactSlot_=0;
+    compactAfter_=nullptr;
     
 }
 
+/**
+* Copies other's structure node for node, so the copy has the same shape
+* and keeps the AVL balances and red-black colors, without going through
+* insert() or rebalancing. O(n). The hash index and the Bloom filter are
+* copied if other has them on; the copy's nodes all live on the heap.
+*/
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>::BinarySearchTree(const BinarySearchTree& other) :
+    bloom_(other.bloom_)
+{
+    root_=nullptr;
+    rotations_=0;
+    size_=0;
+    autoRebalance_=other.autoRebalance_;
+    compactFill_=nullptr;
+    compactEnd_=nullptr;
+    compactStart_=nullptr;
+    compactSlot_=0;
+    compactAfter_=nullptr;
+    copyNodes(other);
+}
+
+/**
+* Takes over other's nodes, compaction blocks, index and filter in O(1),
+* leaving other empty.
+*/
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>::BinarySearchTree(BinarySearchTree&& other) :
+    BinarySearchTree()
+{
+    swapTrees(other);
+}
+
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>& BinarySearchTree<Key, Value>::operator=(const BinarySearchTree& other)
+{
+    if (this != &other) {
+        BinarySearchTree copy(other);
+        swapTrees(copy);
+    }
+    return *this;
+}
+
+/**
+* Frees this tree's items and takes over other's, leaving other empty.
+*/
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>& BinarySearchTree<Key, Value>::operator=(BinarySearchTree&& other)
+{
+    if (this != &other) {
+        BinarySearchTree old(std::move(other));
+        swapTrees(old);
+    }
+    return *this;
+}
+
+/**
+* Exchanges the contents of two trees in O(1). Iterators and node
+* pointers stay valid and move to the other tree. Each derived tree
+* has its own swap(), which only takes a tree of its type; this one is
+* for plain trees.
+* @throws std::invalid_argument if other is a tree of another type,
+*         reached through a BinarySearchTree reference
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::swap(BinarySearchTree& other)
+{
+    if (typeid(*this) != typeid(other)) {
+        throw std::invalid_argument("BinarySearchTree::swap: trees of different types");
+    }
+    swapTrees(other);
+}
+
+/**
+* swap() without the type check, for the derived trees' swaps and for
+* the copies and moves, whose temporaries are plain trees.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::swapTrees(BinarySearchTree& other)
+{
+    std::swap(root_, other.root_);
+    std::swap(rotations_, other.rotations_);
+    std::swap(size_, other.size_);
+    std::swap(autoRebalance_, other.autoRebalance_);
+    blocks_.swap(other.blocks_);
+    std::swap(compactFill_, other.compactFill_);
+    std::swap(compactEnd_, other.compactEnd_);
+    std::swap(compactStart_, other.compactStart_);
+    std::swap(compactSlot_, other.compactSlot_);
+    std::swap(compactAfter_, other.compactAfter_);
+    std::swap(hashIndex_, other.hashIndex_);
+    bloom_.swap(other.bloom_);
+#ifdef BST_STATS
+    std::swap(stats_, other.stats_);
+#endif
+}
+
 template<typename Key, typename Value>
 BinarySearchTree<Key, Value>::~BinarySearchTree()
 {
@@ -411,6 +804,160 @@ void BinarySearchTree<Key, Value>::print() const
     std::cout << "\n";
 }
 
+/**
+* Writes the whole tree as a Graphviz digraph, one node statement per
+* item (labeled with key and value plus whatever exportFields() adds) and
+* one edge per child link, labeled L or R. See exportTree().
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::exportDot(std::ostream& os) const
+{
+    exportTree(os, false);
+}
+
+/**
+* Writes the whole tree as nested JSON objects:
+*   {"key": k, "value": v, ...exportFields()..., "left": {...} or null, "right": ...}
+* or null for an empty tree. Arithmetic keys and values are written as
+* numbers, anything else as a string through operator<<.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::exportJson(std::ostream& os) const
+{
+    exportTree(os, true);
+}
+
+/**
+* Extra per-node fields for the exports; the balancing trees add their
+* balance factor or color. For JSON, write ',"name":value' pairs; for DOT,
+* write '\\n'-separated label lines.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::exportFields(std::ostream& os, Node<Key, Value>* node, bool json) const
+{
+
+}
+
+/**
+* The walk behind exportDot() and exportJson(). It follows parent
+* pointers, so apart from one scratch buffer for formatting keys it uses
+* O(1) memory however large or deep the tree is, and it writes '\n'
+* rather than std::endl so the stream's buffer is only flushed when full.
+* For the fastest dumps give the stream a large buffer.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::exportTree(std::ostream& os, bool json) const
+{
+    std::ostringstream scratch;
+    if (!json) {
+        os << "digraph bst {\n  node [shape=box];\n";
+    } else if (root_ == nullptr) {
+        os << "null\n";
+        return;
+    }
+
+    Node<Key, Value>* node = root_;
+    Node<Key, Value>* from = nullptr;
+    while (node != nullptr) {
+        Node<Key, Value>* left = node->getLeft();
+        Node<Key, Value>* right = node->getRight();
+        if (from == node->getParent()) {
+            // first visit: the node itself, then its left subtree
+            if (json) {
+                os << "{\"key\":";
+                writeJsonScalar(os, node->getKey(), scratch);
+                os << ",\"value\":";
+                writeJsonScalar(os, node->getValue(), scratch);
+                exportFields(os, node, true);
+                os << ",\"left\":";
+            } else {
+                os << "  n" << (const void*)node << " [label=\"";
+                writeEscaped(os, node->getKey(), scratch);
+                os << ": ";
+                writeEscaped(os, node->getValue(), scratch);
+                exportFields(os, node, false);
+                os << "\"];\n";
+                if (node->getParent() != nullptr) {
+                    os << "  n" << (const void*)node->getParent() << " -> n" << (const void*)node
+                       << " [label=" << (node->getParent()->getLeft() == node ? "L" : "R") << "];\n";
+                }
+            }
+            if (left != nullptr) {
+                from = node;
+                node = left;
+                continue;
+            }
+            if (json) os << "null";
+        }
+        if (from != right || right == nullptr) {
+            // the left subtree is done (or absent): now the right one
+            if (json) os << ",\"right\":";
+            if (right != nullptr) {
+                from = node;
+                node = right;
+                continue;
+            }
+            if (json) os << "null";
+        }
+        if (json) os << "}";
+        from = node;
+        node = node->getParent();
+    }
+    os << (json ? "\n" : "}\n");
+}
+
+/**
+* Writes an arithmetic value as a JSON number and anything else as a
+* JSON string.
+*/
+template<typename Key, typename Value>
+template<typename T>
+void BinarySearchTree<Key, Value>::writeJsonScalar(std::ostream& os, const T& value, std::ostringstream& scratch)
+{
+    writeJsonScalar(os, value, scratch, typename std::is_arithmetic<T>::type());
+}
+
+template<typename Key, typename Value>
+template<typename T>
+void BinarySearchTree<Key, Value>::writeJsonScalar(std::ostream& os, const T& value, std::ostringstream&, std::true_type)
+{
+    // promotes chars so they print as numbers
+    os << +value;
+}
+
+template<typename Key, typename Value>
+template<typename T>
+void BinarySearchTree<Key, Value>::writeJsonScalar(std::ostream& os, const T& value, std::ostringstream& scratch, std::false_type)
+{
+    os << '"';
+    writeEscaped(os, value, scratch);
+    os << '"';
+}
+
+/**
+* Writes value through operator<<, escaping quotes, backslashes and
+* control characters so it can sit inside a JSON or DOT string.
+*/
+template<typename Key, typename Value>
+template<typename T>
+void BinarySearchTree<Key, Value>::writeEscaped(std::ostream& os, const T& value, std::ostringstream& scratch)
+{
+    scratch.str(std::string());
+    scratch << value;
+    const std::string& text = scratch.str();
+    for (size_t i = 0; i < text.size(); i++) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if (c < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            os << "\\u00" << hex[c >> 4] << hex[c & 15];
+        } else {
+            os << c;
+        }
+    }
+}
+
 /**
 * Returns an iterator to the "smallest" item in the tree
 */
@@ -441,11 +988,77 @@ template<class Key, class Value>
 typename BinarySearchTree<Key, Value>::iterator
 BinarySearchTree<Key, Value>::find(const Key & k) const
 {
+    BST_TIMED(findLatency);
     Node<Key, Value> *curr = internalFind(k);
     BinarySearchTree<Key, Value>::iterator it(curr);
     return it;
 }
 
+/**
+* Returns an iterator to the item with the given key, k, or the end
+* iterator if k does not exist in the tree. The search starts at hint
+* and only climbs as far as needed, so it is cheap when k is near hint.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::find(iterator hint, const Key & k) const
+{
+    BST_TIMED(findLatency);
+    return iterator(internalFind(k, fingerStart(hint, k)));
+}
+
+/**
+* Looks up every key in keys and stores the results in out, in the same
+* order (end() for a missing key). Up to BATCH_LANES descents run
+* interleaved, one step each in turn, and each step prefetches the child
+* it moves to. The next step of that descent comes a full round later,
+* so on trees larger than the cache the misses of independent lookups
+* overlap instead of being paid one after another. On trees that fit
+* in cache the bookkeeping makes it somewhat slower than find().
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::findBatch(const std::vector<Key>& keys, std::vector<iterator>& out) const
+{
+    const size_t BATCH_LANES = 16;
+    Node<Key, Value>* current[BATCH_LANES];
+    size_t index[BATCH_LANES];
+    size_t lanes = 0;
+    size_t next = 0;
+
+    out.resize(keys.size());
+    BST_STAT(stats_.lookups += keys.size());
+    while (lanes < BATCH_LANES && next < keys.size()) {
+        current[lanes] = root_;
+        index[lanes++] = next++;
+    }
+    while (lanes > 0) {
+        for (size_t lane = 0; lane < lanes; ) {
+            Node<Key, Value>* node = current[lane];
+            const Key& key = keys[index[lane]];
+            BST_STAT(if (node != nullptr) { stats_.nodesVisited++; stats_.comparisons++; });
+            if (node == nullptr || key == node->getKey()) {
+                // this descent is done; start the next key in its lane,
+                // or retire the lane by moving the last one into it
+                out[index[lane]] = iterator(node);
+                if (next < keys.size()) {
+                    current[lane] = root_;
+                    index[lane++] = next++;
+                }
+                else {
+                    lanes--;
+                    current[lane] = current[lanes];
+                    index[lane] = index[lanes];
+                }
+                continue;
+            }
+            BST_STAT(stats_.comparisons++);
+            node = key < node->getKey() ? node->getLeft() : node->getRight();
+            __builtin_prefetch(node);
+            current[lane++] = node;
+        }
+    }
+}
+
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
@@ -453,6 +1066,7 @@ BinarySearchTree<Key, Value>::find(const Key & k) const
 template<class Key, class Value>
 Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
 {
+    BST_TIMED(findLatency);
     Node<Key, Value> *curr = internalFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
@@ -460,6 +1074,7 @@ Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
 template<class Key, class Value>
 Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
 {
+    BST_TIMED(findLatency);
     Node<Key, Value> *curr = internalFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
@@ -475,30 +1090,22 @@ template<class Key, class Value>
 void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
 {
     // TODO
+    BST_TIMED(insertLatency);
     if (root_==nullptr){
-        root_ = new Node <Key, Value> (keyValuePair.first, keyValuePair.second, nullptr);
+        root_ = createNode<Node<Key, Value> >(keyValuePair.first, keyValuePair.second, nullptr);
         return;
     }
 
-    Node <Key, Value> *current = root_;
-    Node <Key, Value> *parent = nullptr;
-
-    while (current != nullptr) {
-        parent = current;
-        
-        if (keyValuePair.first == current->getKey()) {
-            // Key already exists, update value
-            current->setValue(keyValuePair.second);
-            return;
-        } else if (keyValuePair.first < current->getKey()) {
-            current = current->getLeft();
-        } else {
-            current = current->getRight();
-        }
+    Node <Key, Value> *parent;
+    Node <Key, Value> *current = descend(keyValuePair.first, root_, parent);
+    if (current != nullptr) {
+        // Key already exists, update value
+        current->setValue(keyValuePair.second);
+        return;
     }
     
     // Create new node with parent
-    Node<Key, Value>* newNode = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, parent);
+    Node<Key, Value>* newNode = createNode<Node<Key, Value> >(keyValuePair.first, keyValuePair.second, parent);
     
     // Link parent to new node
     if (keyValuePair.first < parent->getKey()) {
@@ -506,7 +1113,41 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
     } else {
         parent->setRight(newNode);
     }
-    
+    checkDepth(newNode);
+
+}
+
+
+/**
+* Inserts keyValuePair, starting the search for its position at hint
+* instead of the root. The result is the same as insert(keyValuePair);
+* only the amount of work differs. Returns an iterator to the item.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::insert(iterator hint, const std::pair<const Key, Value> &keyValuePair)
+{
+    BST_TIMED(insertLatency);
+    if (root_ == nullptr) {
+        root_ = createNode<Node<Key, Value> >(keyValuePair.first, keyValuePair.second, nullptr);
+        return iterator(root_);
+    }
+
+    Node<Key, Value>* parent;
+    Node<Key, Value>* current = descend(keyValuePair.first, fingerStart(hint, keyValuePair.first), parent);
+    if (current != nullptr) {
+        current->setValue(keyValuePair.second);
+        return iterator(current);
+    }
+
+    Node<Key, Value>* newNode = createNode<Node<Key, Value> >(keyValuePair.first, keyValuePair.second, parent);
+    if (keyValuePair.first < parent->getKey()) {
+        parent->setLeft(newNode);
+    } else {
+        parent->setRight(newNode);
+    }
+    checkDepth(newNode);
+    return iterator(newNode);
 }
 
 
@@ -519,6 +1160,7 @@ template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::remove(const Key& key)
 {
     // TODO
+    BST_TIMED(removeLatency);
     Node<Key, Value>* nodeToRemove = internalFind(key);
     
     // Key not found
@@ -526,6 +1168,16 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
         return;
     }
     
+    freeNode(detach(nodeToRemove));
+}
+
+/**
+* Unlinks node from the tree without freeing it, and returns it with
+* its links cleared. Derived trees override this to rebalance.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::detach(Node<Key, Value>* nodeToRemove)
+{
     // Case 1: Node has two children
     if (nodeToRemove->getLeft() != nullptr && nodeToRemove->getRight() != nullptr) {
         // Find predecessor
@@ -553,22 +1205,322 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
         parent->setRight(child);
     }
     
-    // Delete the node
-    delete nodeToRemove;
+    nodeToRemove->setParent(nullptr);
+    nodeToRemove->setLeft(nullptr);
+    nodeToRemove->setRight(nullptr);
+    return nodeToRemove;
 }
 
+/**
+* Removes the item with the given key from the tree and returns a handle
+* owning its node, or an empty handle if the key is not in the tree.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::node_handle
+BinarySearchTree<Key, Value>::extract(const Key& key)
+{
+    return extractHandle<node_handle>(key);
+}
 
-
-template<class Key, class Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+/**
+* Unlinks the node with the given key for a handle, or returns nullptr.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::extractNode(const Key& key)
 {
-    // TODO
-    if (current == nullptr) {
+    Node<Key, Value>* node = internalFind(key);
+    if (node == nullptr) {
         return nullptr;
     }
-    
-    // If left subtree exists, predecessor is the rightmost node in left subtree
+    size_--;
+    node = detach(node);
+    unindexNode(node);
+    if (compactBlock(node) != nullptr) {
+        // handles own their node outright, so move it out of the block
+        Node<Key, Value>* copy = node->copyTo(::operator new(node->nodeSize()));
+        releaseNode(node);
+        node = copy;
+    }
+    return node;
+}
+
+/**
+* extract() for a tree whose node_handle is Handle. The tree only makes
+* nodes of Handle's node type, so the cast is safe.
+*/
+template<typename Key, typename Value>
+template<typename Handle>
+Handle BinarySearchTree<Key, Value>::extractHandle(const Key& key)
+{
+    return Handle(static_cast<typename Handle::node_type*>(extractNode(key)));
+}
+
+/**
+* insert(node_handle&&) for a tree whose node_handle is Handle: adopt()
+* links the node, and the handle lets go of it if that worked. Through a
+* base reference the handle may come from a tree of another type, whose
+* node adopt() must not take.
+* @throws std::invalid_argument if the node is not of this tree's type;
+*         the handle keeps it
+*/
+template<typename Key, typename Value>
+template<typename Handle>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+BinarySearchTree<Key, Value>::insertHandle(Handle& nh)
+{
+    if (nh.node_ == nullptr) {
+        return std::make_pair(end(), false);
+    }
+    if (typeid(*nh.node_) != nodeType()) {
+        throw std::invalid_argument("BinarySearchTree::insert: node handle from a tree of another type");
+    }
+    std::pair<iterator, bool> result = adopt(nh.node_);
+    if (result.second) {
+        nh.node_ = nullptr;
+    }
+    return result;
+}
+
+/**
+* Removes the item at pos and returns an iterator to the one after it,
+* without searching for either. The successor is taken before the
+* detach, which relinks nodes rather than moving items, so it stays
+* good; only pos is invalidated.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::erase(iterator pos)
+{
+    Node<Key, Value>* next = successor(pos.current_);
+    freeNode(detach(pos.current_));
+    return iterator(next);
+}
+
+/**
+* Removes every item with lo <= key < hi and returns how many there were.
+* The range is cut out of the tree as one subtree, by splitting the tree
+* at lo and hi and joining the outer parts back together, and then
+* freed in one pass; remove() per key would descend, swap and rebalance
+* k times. O(height + k) here, O(log n + k) for AVLTree.
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::erase(const Key& lo, const Key& hi)
+{
+    Node<Key, Value>* first = lowerBound(lo);
+    if (first == nullptr || !(first->getKey() < hi)) {
+        return 0;
+    }
+    size_t before = size_;
+    freeSubtree(cutRange(lo, &hi));
+    return before - size_;
+}
+
+/**
+* Removes the items in [first, last) the same way and returns last.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::erase(iterator first, iterator last)
+{
+    if (first == last) {
+        return last;
+    }
+    // first's node is about to go
+    Key lo = first->first;
+    freeSubtree(cutRange(lo, last == end() ? nullptr : &last->first));
+    return last;
+}
+
+/**
+* Unlinks the items with lo <= key < hi (no upper bound if hi is null)
+* and returns them as a detached subtree; there is at least one. The
+* plain tree splits at both bounds and hangs what is above the range
+* below the largest item under it, without rebalancing.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::cutRange(const Key& lo, const Key* hi)
+{
+    Node<Key, Value>* less;
+    Node<Key, Value>* rest;
+    Node<Key, Value>* range = nullptr;
+    Node<Key, Value>* greater = nullptr;
+    splitAt(root_, lo, less, rest);
+    if (hi != nullptr) {
+        splitAt(rest, *hi, range, greater);
+    } else {
+        range = rest;
+    }
+    root_ = less != nullptr ? less : greater;
+    if (less != nullptr && greater != nullptr) {
+        Node<Key, Value>* max = less;
+        while (max->getRight() != nullptr) {
+            max = max->getRight();
+        }
+        max->setRight(greater);
+        greater->setParent(max);
+    }
+    return range;
+}
+
+/**
+* Splits the subtree under top into the keys less than k and the rest,
+* in one walk down the search path for k: each node on it goes, with
+* the subtree on its far side, to whichever part it belongs to.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::splitAt(Node<Key, Value>* top, const Key& k,
+                                           Node<Key, Value>*& less, Node<Key, Value>*& rest)
+{
+    less = rest = nullptr;
+    Node<Key, Value>* lessTail = nullptr;   // its right link is still open
+    Node<Key, Value>* restTail = nullptr;   // its left link is still open
+    while (top != nullptr) {
+        if (top->getKey() < k) {
+            if (lessTail == nullptr) less = top; else lessTail->setRight(top);
+            top->setParent(lessTail);
+            lessTail = top;
+            top = top->getRight();
+        } else {
+            if (restTail == nullptr) rest = top; else restTail->setLeft(top);
+            top->setParent(restTail);
+            restTail = top;
+            top = top->getLeft();
+        }
+    }
+    if (lessTail != nullptr) lessTail->setRight(nullptr);
+    if (restTail != nullptr) restTail->setLeft(nullptr);
+}
+
+/**
+* Clones other's nodes into this empty tree with Node::copyTo(), which
+* copies whatever the node type adds. Walks both trees in step, in
+* preorder and without recursing: each copy starts with other's links,
+* which are replaced as its children are made.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::copyNodes(const BinarySearchTree& other)
+{
+    if (other.hashIndex_.enabled()) {
+        hashIndex_.enable(other.hashIndex_.hashFunction(), other.size_);
+    }
+    Node<Key, Value>* from = other.root_;
+    Node<Key, Value>* parent = nullptr;
+    while (from != nullptr) {
+        BST_STAT(stats_.allocated(from->nodeSize()));
+        Node<Key, Value>* copy = from->copyTo(::operator new(from->nodeSize()));
+        size_++;
+        if (hashIndex_.enabled()) hashIndex_.add(copy);
+        copy->setParent(parent);
+        copy->setLeft(nullptr);
+        copy->setRight(nullptr);
+        if (parent == nullptr) root_ = copy;
+        else if (from == from->getParent()->getLeft()) parent->setLeft(copy);
+        else parent->setRight(copy);
+
+        // next in preorder: the left child, else the right child of the
+        // nearest node (this one included) whose right subtree is left
+        if (from->getLeft() != nullptr) {
+            parent = copy;
+            from = from->getLeft();
+            continue;
+        }
+        while (from != nullptr && (from->getRight() == nullptr || copy->getRight() != nullptr)) {
+            from = from->getParent();
+            copy = copy->getParent();
+        }
+        if (from != nullptr) {
+            parent = copy;
+            from = from->getRight();
+        }
+    }
+}
+
+/**
+* Frees a detached subtree bottom-up without recursing.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::freeSubtree(Node<Key, Value>* top)
+{
+    Node<Key, Value>* node = top;
+    while (node != nullptr) {
+        if (node->getLeft() != nullptr) {
+            node = node->getLeft();
+        } else if (node->getRight() != nullptr) {
+            node = node->getRight();
+        } else {
+            Node<Key, Value>* parent = node == top ? nullptr : node->getParent();
+            if (parent != nullptr) {
+                if (parent->getLeft() == node) parent->setLeft(nullptr); else parent->setRight(nullptr);
+            }
+            freeNode(node);
+            node = parent;
+        }
+    }
+}
+
+/**
+* Links the node owned by nh into the tree and empties nh. If the key is
+* already present nothing changes, nh keeps its node, and the returned
+* iterator points at the existing item.
+*/
+template<typename Key, typename Value>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+BinarySearchTree<Key, Value>::insert(node_handle&& nh)
+{
+    return insertHandle(nh);
+}
+
+/**
+* Links a node taken from a handle into the tree, unless its key is
+* already present; the second member says which. Each tree links and
+* rebalances the way its own inserts do.
+*/
+template<typename Key, typename Value>
+std::pair<typename BinarySearchTree<Key, Value>::iterator, bool>
+BinarySearchTree<Key, Value>::adopt(Node<Key, Value>* newNode)
+{
+    Node<Key, Value>* parent;
+    Node<Key, Value>* current = descend(newNode->getKey(), root_, parent);
+    if (current != nullptr) {
+        return std::make_pair(iterator(current), false);
+    }
+
+    indexNode(newNode);
+    size_++;
+    newNode->setParent(parent);
+    if (parent == nullptr) {
+        root_ = newNode;
+    } else if (newNode->getKey() < parent->getKey()) {
+        parent->setLeft(newNode);
+    } else {
+        parent->setRight(newNode);
+    }
+    checkDepth(newNode);
+    return std::make_pair(iterator(newNode), true);
+}
+
+/**
+* The dynamic type of the nodes this tree makes; insertHandle() takes
+* only those.
+*/
+template<typename Key, typename Value>
+const std::type_info& BinarySearchTree<Key, Value>::nodeType() const
+{
+    return typeid(Node<Key, Value>);
+}
+
+
+
+template<class Key, class Value>
+Node<Key, Value>*
+BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+{
+    // TODO
+    if (current == nullptr) {
+        return nullptr;
+    }
+    
+    // If left subtree exists, predecessor is the rightmost node in left subtree
     if (current->getLeft() != nullptr) {
         current = current->getLeft();
         while (current->getRight() != nullptr) {
@@ -587,6 +1539,30 @@ BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
     return parent;
 }
 
+/**
+* Returns the node after current in key order, or nullptr if it is the
+* last one.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>*
+BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
+{
+    if (current->getRight() != nullptr) {
+        current = current->getRight();
+        while (current->getLeft() != nullptr) {
+            current = current->getLeft();
+        }
+        return current;
+    }
+
+    Node<Key, Value>* parent = current->getParent();
+    while (parent != nullptr && current == parent->getRight()) {
+        current = parent;
+        parent = parent->getParent();
+    }
+    return parent;
+}
+
 
 /**
 * A method to remove all contents of the tree and
@@ -596,6 +1572,16 @@ template<typename Key, typename Value>
 void BinarySearchTree<Key, Value>::clear() {
     deleteNodes(root_);
     root_ = nullptr;
+    size_ = 0;
+    hashIndex_.clear();
+    if (bloom_.enabled()) bloom_.reset(0);
+    endCompaction();
+    for (size_t i = 0; i < blocks_.size(); i++) {
+        if (blocks_[i].start != blocks_[i].end) {
+            ::operator delete(blocks_[i].start);
+        }
+    }
+    blocks_.clear();
 }
 
 template<typename Key, typename Value>
@@ -604,7 +1590,9 @@ void BinarySearchTree<Key, Value>::deleteNodes(Node<Key, Value>* node) {
         return;
     deleteNodes(node->getLeft());
     deleteNodes(node->getRight());
-    delete node;
+    // not freeNode(): clear() resets the index and filter wholesale
+    BST_STAT(stats_.frees++);
+    releaseNode(node);
 }
 
 
@@ -639,12 +1627,45 @@ template<typename Key, typename Value>
 Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
 {
     // TODO
-    Node<Key, Value>* current = root_;
-    
+    if (bloom_.enabled() && !bloom_.mayContain(key)) {
+        BST_STAT(stats_.lookups++);
+        BST_STAT(stats_.filtered++);
+        return nullptr;
+    }
+    if (hashIndex_.enabled()) {
+        BST_STAT(stats_.lookups++);
+        return hashIndex_.find(key);
+    }
+    return internalFind(key, root_);
+}
+
+/**
+* Same as internalFind(key), but descends from start, which must be
+* the root of a subtree that would hold key.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key, Node<Key, Value>* start) const
+{
+    BST_STAT(stats_.lookups++);
+    return findFrom(key, start, typename std::is_integral<Key>::type());
+}
+
+/**
+* internalFind() for general keys.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::findFrom(const Key& key, Node<Key, Value>* start, std::false_type) const
+{
+    Node<Key, Value>* current = start;
+
     while (current != nullptr) {
+        BST_STAT(stats_.nodesVisited++);
+        BST_STAT(stats_.comparisons++);
         if (key == current->getKey()) {
             return current;
-        } else if (key < current->getKey()) {
+        }
+        BST_STAT(stats_.comparisons++);
+        if (key < current->getKey()) {
             current = current->getLeft();
         } else {
             current = current->getRight();
@@ -654,6 +1675,768 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
     return nullptr;
 }
 
+/**
+* internalFind() for integral keys, using the branchless descent.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::findFrom(const Key& key, Node<Key, Value>* start, std::true_type) const
+{
+#ifdef BST_STATS
+    uint64_t visited = stats_.nodesVisited;
+#endif
+    Node<Key, Value>* parent;
+    Node<Key, Value>* found = descend(key, start, parent, std::true_type());
+    // an == and a < per level, except the == that found the key
+    BST_STAT(stats_.comparisons += 2 * (stats_.nodesVisited - visited) - (found != nullptr ? 1 : 0));
+    return found;
+}
+
+/**
+* Descends from start to the node holding key and returns it, or returns
+* nullptr if there is none. Either way parent is left at the last node
+* visited, which is where a new node for key would be linked. Used by
+* the insert paths of every tree.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::descend(const Key& key, Node<Key, Value>* start, Node<Key, Value>*& parent) const
+{
+    return descend(key, start, parent, typename std::is_integral<Key>::type());
+}
+
+/**
+* descend() for general keys, which only need operator<.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::descend(const Key& key, Node<Key, Value>* current,
+                                                       Node<Key, Value>*& parent, std::false_type) const
+{
+    parent = nullptr;
+    while (current != nullptr) {
+        parent = current;
+        BST_STAT(stats_.nodesVisited++);
+        if (key < current->getKey()) {
+            current = current->getLeft();
+        } else if (current->getKey() < key) {
+            current = current->getRight();
+        } else {
+            return current;
+        }
+    }
+    return nullptr;
+}
+
+/**
+* descend() for integral keys. The key is copied out of the node and the
+* only branch per level is the equality exit, which is rarely taken; the
+* child is picked by indexing with the comparison result, which compiles
+* to a conditional move instead of a branch that random keys mispredict
+* half the time.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::descend(const Key& key, Node<Key, Value>* current,
+                                                       Node<Key, Value>*& parent, std::true_type) const
+{
+    parent = nullptr;
+    while (current != nullptr) {
+        parent = current;
+        BST_STAT(stats_.nodesVisited++);
+        const Key nodeKey = current->getKey();
+        if (key == nodeKey) {
+            return current;
+        }
+        current = current->getChild(nodeKey < key);
+    }
+    return nullptr;
+}
+
+/**
+* Finger search helper. Climbs from the hinted node until reaching a
+* subtree whose key range must contain k, and returns that subtree's
+* root (or the node holding k, if it is passed on the way). Returns
+* the root when the hint is end().
+*/
+template<typename Key, typename Value>
+Node<Key, Value>*
+BinarySearchTree<Key, Value>::fingerStart(const iterator& hint, const Key& k) const
+{
+    Node<Key, Value>* current = hint.current_;
+    if (current == nullptr || k == current->getKey()) {
+        return current == nullptr ? root_ : current;
+    }
+
+    // Only the bound on one side can exclude k: if k is right of the hint,
+    // stop at the first ancestor that holds this subtree on its left and
+    // whose key is still greater than k (and symmetrically).
+    // Past maxClimb levels k is far from the hint and climbing further
+    // costs as much as starting over from the root.
+    const int maxClimb = 8;
+    bool goRight = current->getKey() < k;
+    Node<Key, Value>* parent = current->getParent();
+    for (int climbed = 0; parent != nullptr; climbed++) {
+        if (climbed == maxClimb) return root_;
+        if (goRight && current == parent->getLeft()) {
+            if (k < parent->getKey()) return current;
+            if (k == parent->getKey()) return parent;
+        }
+        else if (!goRight && current == parent->getRight()) {
+            if (parent->getKey() < k) return current;
+            if (k == parent->getKey()) return parent;
+        }
+        current = parent;
+        parent = current->getParent();
+    }
+    return current;
+}
+
+/**
+* Wraps a node in an iterator, for use by derived trees.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::iteratorAt(Node<Key, Value>* node)
+{
+    return iterator(node);
+}
+
+/**
+* Allocates a node for this tree. All nodes are created through here
+* (and freed through freeNode) so the allocation statistics see them.
+* If copying the key or value or indexing the node throws, the tree is
+* left as it was.
+*/
+template<typename Key, typename Value>
+template<typename NodeT>
+NodeT* BinarySearchTree<Key, Value>::createNode(const Key& key, const Value& value, NodeT* parent)
+{
+    NodeT* node = new NodeT(key, value, parent);
+    try {
+        indexNode(node);
+    }
+    catch (...) {
+        delete node;
+        throw;
+    }
+    BST_STAT(stats_.allocated(sizeof(NodeT)));
+    size_++;
+    return node;
+}
+
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::freeNode(Node<Key, Value>* node)
+{
+    BST_STAT(stats_.frees++);
+    size_--;
+    unindexNode(node);
+    releaseNode(node);
+}
+
+/**
+* Destroys a node that has been unlinked (or replaced by a copy), whether
+* it came from new or sits in one of compact()'s blocks. A block is freed
+* with its last node, unless a pass is still filling it.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::releaseNode(Node<Key, Value>* node)
+{
+    CompactBlock* block = blocks_.empty() ? nullptr : compactBlock(node);
+    if (block == nullptr) {
+        delete node;
+        return;
+    }
+    node->~Node();
+    if (--block->live == 0 && block->start != compactStart_) {
+        freeBlock(*block);
+    }
+}
+
+/**
+* Frees a block's memory and leaves it in blocks_ as an empty range,
+* which no address falls in, so releasing a node costs no vector::erase.
+* That is safe because compact() sweeps the freed blocks out before it
+* adds one, so every block in blocks_ was allocated while the others
+* were, and they cannot overlap.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::freeBlock(CompactBlock& block)
+{
+    ::operator delete(block.start);
+    block.end = block.start;
+}
+
+/**
+* Returns the compact() block holding p, or nullptr if p came from new.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::CompactBlock*
+BinarySearchTree<Key, Value>::compactBlock(const void* p)
+{
+    // the last block starting at or before p
+    size_t lo = 0, hi = blocks_.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if ((const char*)p < blocks_[mid].start) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    if (lo == 0 || (const char*)p >= blocks_[lo - 1].end) {
+        return nullptr;
+    }
+    return &blocks_[lo - 1];
+}
+
+/**
+* Returns the number of rotations performed since construction. Always
+* 0 for the unbalanced tree.
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::rotations() const
+{
+    return rotations_;
+}
+
+/**
+* Returns a snapshot of the operation statistics. The counters are only
+* maintained when compiled with BST_STATS; otherwise everything but
+* the rotation count is zero.
+*/
+template<typename Key, typename Value>
+BSTStats BinarySearchTree<Key, Value>::stats() const
+{
+#ifdef BST_STATS
+    BSTStats snapshot = stats_;
+#else
+    BSTStats snapshot;
+#endif
+    snapshot.rotations = rotations_;
+    return snapshot;
+}
+
+/**
+* Zeroes the operation counters and histograms. The allocation counts
+* are kept so that liveNodes() stays correct.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::resetStats()
+{
+#ifdef BST_STATS
+    BSTStats fresh;
+    fresh.allocations = stats_.allocations;
+    fresh.frees = stats_.frees;
+    fresh.nodeBytes = stats_.nodeBytes;
+    stats_ = fresh;
+#endif
+}
+
+/**
+* Measures the tree's shape in one O(n) pass. The walk follows parent
+* pointers instead of recursing, and keeps a stack of finished subtree
+* heights with at most one entry per level, so even a degenerate tree is
+* measured in O(height) extra memory and without overflowing the call
+* stack.
+*/
+template<typename Key, typename Value>
+ShapeStats BinarySearchTree<Key, Value>::shapeStats() const
+{
+    ShapeStats shape;
+    std::vector<int> heights;   // heights of finished subtrees, innermost last
+    double depthSum = 0;
+    Node<Key, Value>* node = root_;
+    Node<Key, Value>* from = nullptr;  // the node the walk came from
+    int depth = 1;
+
+    while (node != nullptr) {
+        Node<Key, Value>* left = node->getLeft();
+        Node<Key, Value>* right = node->getRight();
+        if (from == node->getParent()) {
+            // first visit
+            shape.nodes++;
+            depthSum += depth;
+            if (depth > shape.maxDepth) {
+                shape.maxDepth = depth;
+            }
+            if (left != nullptr) {
+                from = node;
+                node = left;
+                depth++;
+                continue;
+            }
+        }
+        if (right != nullptr && from != right) {
+            from = node;
+            node = right;
+            depth++;
+            continue;
+        }
+
+        // both subtrees are done: their heights are on top of the stack
+        int rightHeight = 0, leftHeight = 0;
+        if (right != nullptr) {
+            rightHeight = heights.back();
+            heights.pop_back();
+        }
+        if (left != nullptr) {
+            leftHeight = heights.back();
+            heights.pop_back();
+        }
+        if (left == nullptr && right == nullptr) {
+            shape.leaves++;
+            if (shape.leafDepths.size() <= (size_t)depth) {
+                shape.leafDepths.resize(depth + 1);
+            }
+            shape.leafDepths[depth]++;
+        }
+        if (std::abs(leftHeight - rightHeight) > 1) {
+            shape.unbalancedNodes++;
+        }
+        heights.push_back(std::max(leftHeight, rightHeight) + 1);
+        from = node;
+        node = node->getParent();
+        depth--;
+    }
+
+    shape.height = shape.maxDepth;
+    if (shape.nodes > 0) {
+        shape.averageDepth = depthSum / shape.nodes;
+        // internalFind() compares == and < at each level above the key,
+        // and == once at the key
+        shape.comparisonsPerHit = 2 * shape.averageDepth - 1;
+    }
+    return shape;
+}
+
+/**
+* Returns the number of items in the tree.
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::size() const
+{
+    return size_;
+}
+
+/**
+* Rebuilds the tree into a perfectly balanced one in O(n) time and O(1)
+* extra space, reusing the existing nodes (Day-Stout-Warren). The
+* balancing trees override this, as they never need it.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rebalance()
+{
+    if (root_ != nullptr) {
+        rebuild(root_);
+    }
+}
+
+/**
+* Turns automatic rebalancing on for c > 1, or off for c = 0. When an
+* insert lands deeper than c * log2(n), the subtree of its deepest
+* ancestor whose child outweighs it by more than 2^(-1/c) of its size
+* is rebuilt as in rebalance() (the scapegoat tree rule). Such an
+* ancestor always exists at that depth, and charging each rebuild to the
+* inserts that unbalanced it keeps inserts at amortized O(log n), where
+* rebuilding the whole tree each time would cost O(n) per insert on a
+* sorted stream. Only the plain tree's inserts check the depth.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::setAutoRebalance(double c)
+{
+    autoRebalance_ = c > 1 ? c : 0;
+}
+
+/**
+* Moves the nodes, in key order, into one freshly allocated block, so
+* that neighbouring keys share cache lines and pages again after churn
+* has scattered them across the heap. A full scan then reads memory
+* sequentially, and lookups touch fewer pages.
+*
+* A pass moves at most maxNodes nodes per call and returns true once it
+* is complete, so compact(4096) can be called between other operations
+* until it returns true without pausing the tree for long. The tree may
+* change between calls: nodes inserted behind the pass or once the
+* block is full stay where they are. Moving a node invalidates
+* iterators to it. The blocks of earlier passes are freed once all of
+* their nodes have been moved or removed.
+*/
+template<typename Key, typename Value>
+bool BinarySearchTree<Key, Value>::compact(size_t maxNodes)
+{
+    if (root_ == nullptr) {
+        endCompaction();
+        return true;
+    }
+    if (compactFill_ == nullptr) {
+        const size_t align = alignof(std::max_align_t);
+        compactSlot_ = (root_->nodeSize() + align - 1) / align * align;
+        compactStart_ = static_cast<char*>(::operator new(compactSlot_ * size_));
+        compactFill_ = compactStart_;
+        compactEnd_ = compactStart_ + compactSlot_ * size_;
+        CompactBlock block = { compactStart_, compactEnd_, 0 };
+        size_t kept = 0;
+        for (size_t i = 0; i < blocks_.size(); i++) {
+            if (blocks_[i].start != blocks_[i].end) blocks_[kept++] = blocks_[i];
+        }
+        blocks_.resize(kept);
+        size_t i = 0;
+        while (i < blocks_.size() && blocks_[i].start < block.start) i++;
+        blocks_.insert(blocks_.begin() + i, block);
+    }
+
+    Node<Key, Value>* node = compactAfter_ != nullptr ? firstAfter(*compactAfter_) : getSmallestNode();
+    Node<Key, Value>* last = nullptr;
+    // blocks_ only changes shape when a pass starts, so this stays valid
+    CompactBlock* fill = compactBlock(compactStart_);
+    for (size_t moved = 0; node != nullptr && moved < maxNodes && compactFill_ != compactEnd_; moved++) {
+        // a node of another type (from a node handle) may not fit
+        if (node->nodeSize() <= compactSlot_) {
+            Node<Key, Value>* copy = node->copyTo(compactFill_);
+            fill->live++;
+            compactFill_ += compactSlot_;
+            relink(node, copy);
+            releaseNode(node);
+            node = copy;
+        }
+        last = node;
+        iterator next(node);
+        ++next;
+        node = next.current_;
+    }
+
+    if (node == nullptr || compactFill_ == compactEnd_) {
+        endCompaction();
+        return true;
+    }
+    // a heap copy, so that keys need not be default constructible
+    Key* after = new Key(last->getKey());
+    delete compactAfter_;
+    compactAfter_ = after;
+    return false;
+}
+
+/**
+* Ends the pass in progress, if any, freeing its block if nothing is
+* left in it.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::endCompaction()
+{
+    if (compactFill_ == nullptr) return;
+    CompactBlock* block = compactBlock(compactStart_);
+    compactFill_ = compactEnd_ = compactStart_ = nullptr;
+    delete compactAfter_;
+    compactAfter_ = nullptr;
+    if (block->live == 0) {
+        freeBlock(*block);
+    }
+}
+
+/**
+* Points everything that linked to old at copy, which has old's links.
+* Trees with extra links between nodes override this.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::relink(Node<Key, Value>* old, Node<Key, Value>* copy)
+{
+    Node<Key, Value>* parent = copy->getParent();
+    if (parent == nullptr) {
+        root_ = copy;
+    } else if (parent->getLeft() == old) {
+        parent->setLeft(copy);
+    } else {
+        parent->setRight(copy);
+    }
+    if (copy->getLeft() != nullptr) copy->getLeft()->setParent(copy);
+    if (copy->getRight() != nullptr) copy->getRight()->setParent(copy);
+    if (hashIndex_.enabled()) hashIndex_.replace(old, copy);
+}
+
+/**
+* Returns the node with the smallest key not less than k, or nullptr.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::lowerBound(const Key& k) const
+{
+    Node<Key, Value>* node = root_;
+    Node<Key, Value>* best = nullptr;
+    while (node != nullptr) {
+        if (node->getKey() < k) {
+            node = node->getRight();
+        } else {
+            best = node;
+            node = node->getLeft();
+        }
+    }
+    return best;
+}
+
+/**
+* Returns the node with the smallest key greater than k, or nullptr.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::firstAfter(const Key& k) const
+{
+    Node<Key, Value>* node = root_;
+    Node<Key, Value>* best = nullptr;
+    while (node != nullptr) {
+        if (k < node->getKey()) {
+            best = node;
+            node = node->getLeft();
+        } else {
+            node = node->getRight();
+        }
+    }
+    return best;
+}
+
+/**
+* Turns the hash side index on or off. While it is on, every node is
+* also entered in an open-addressing hash table keyed by std::hash<Key>,
+* and find(key), operator[], remove() and extract() look keys up there
+* in O(1) expected time instead of descending the tree. Iteration,
+* hinted operations and findBatch() still use the tree, so order is
+* unaffected. Costs 16 bytes per slot at a load factor of 3/8 to 3/4
+* (see hashIndexBytes()) plus a hash per insert and remove; worth it
+* for workloads dominated by exact-key lookups. Turning it on indexes
+* the current contents in O(n). Key must have a std::hash
+* specialization, but only trees that call this need one.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::setHashIndex(bool on)
+{
+    if (!on) {
+        hashIndex_.disable();
+        return;
+    }
+    if (hashIndex_.enabled()) return;
+    hashIndex_.enable(&hashKey<Key>, size_);
+    for (iterator it = begin(); it != end(); ++it) {
+        hashIndex_.add(it.current_);
+    }
+}
+
+/**
+* Returns the memory taken by the hash side index, 0 when it is off.
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::hashIndexBytes() const
+{
+    return hashIndex_.bytes();
+}
+
+/**
+* Turns the Bloom filter in front of lookups on (bitsPerKey > 0) or off.
+* While it is on, find(key), operator[], remove() and extract() first
+* ask the filter, which rules out an absent key with one cache-line read
+* instead of a descent to a leaf; a present key pays that read on top.
+* At 10 bits per key about 1% of absent keys still get through. Removed
+* keys stay in the filter until it is rebuilt from the tree, which
+* happens once they exceed staleFraction of the keys it holds, or the
+* tree has outgrown it; both take O(n) operations to reach, so the
+* rebuilds cost O(1) amortized per operation. Key must have a
+* std::hash specialization, but only trees that call this need one.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::setBloomFilter(double bitsPerKey, double staleFraction)
+{
+    if (bitsPerKey <= 0) {
+        bloom_.disable();
+        return;
+    }
+    bloom_.enable(&hashKey<Key>, bitsPerKey, staleFraction);
+    rebuildBloomFilter();
+}
+
+/**
+* Returns the memory taken by the Bloom filter, 0 when it is off.
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::bloomFilterBytes() const
+{
+    return bloom_.bytes();
+}
+
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rebuildBloomFilter()
+{
+    bloom_.reset(size_);
+    for (iterator it = begin(); it != end(); ++it) {
+        bloom_.add(it->first);
+    }
+}
+
+/**
+* Enters a node that is joining the tree in the Bloom filter and the
+* hash index, whichever are on. The node may not be linked in yet, so a
+* due filter rebuild happens before its key is added. The hash index
+* comes last: if it throws, the node is in neither, and at worst the
+* filter holds a key too many.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::indexNode(Node<Key, Value>* node)
+{
+    if (bloom_.enabled()) {
+        if (bloom_.needsRebuild()) rebuildBloomFilter();
+        bloom_.add(node->getKey());
+    }
+    if (hashIndex_.enabled()) hashIndex_.add(node);
+}
+
+/**
+* Takes a node that has left (or is leaving) the tree out of the hash
+* index and counts it against the Bloom filter.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::unindexNode(Node<Key, Value>* node)
+{
+    if (hashIndex_.enabled()) hashIndex_.remove(node);
+    if (bloom_.enabled()) {
+        bloom_.removed();
+        if (bloom_.needsRebuild()) rebuildBloomFilter();
+    }
+}
+
+template<typename Key, typename Value>
+template<typename K>
+size_t BinarySearchTree<Key, Value>::hashKey(const K& key)
+{
+    return std::hash<K>()(key);
+}
+
+/**
+* Rotates node above its parent, keeping the parent pointers and root_
+* up to date. Works in both directions.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::rotateUp(Node<Key, Value>* node)
+{
+    Node<Key, Value>* parent = node->getParent();
+    Node<Key, Value>* grandparent = parent->getParent();
+    if (node == parent->getLeft()) {
+        Node<Key, Value>* moved = node->getRight();
+        parent->setLeft(moved);
+        if (moved != nullptr) moved->setParent(parent);
+        node->setRight(parent);
+    } else {
+        Node<Key, Value>* moved = node->getLeft();
+        parent->setRight(moved);
+        if (moved != nullptr) moved->setParent(parent);
+        node->setLeft(parent);
+    }
+    parent->setParent(node);
+    node->setParent(grandparent);
+    if (grandparent == nullptr) {
+        root_ = node;
+    } else if (grandparent->getLeft() == parent) {
+        grandparent->setLeft(node);
+    } else {
+        grandparent->setRight(node);
+    }
+}
+
+/**
+* Day-Stout-Warren on the subtree at top: right rotations first flatten
+* it into a sorted right-leaning vine, then rounds of left rotations
+* along the vine fold it into a complete tree. Returns the new subtree
+* root, which is linked where top was.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::rebuild(Node<Key, Value>* top)
+{
+    size_t n = 0;
+    Node<Key, Value>* node = top;
+    while (node != nullptr) {
+        Node<Key, Value>* left = node->getLeft();
+        if (left != nullptr) {
+            rotateUp(left);
+            if (node == top) top = left;
+            node = left;
+        } else {
+            n++;
+            node = node->getRight();
+        }
+    }
+
+    // n = 2^k - 1 + extra; the first round leaves the extra nodes as
+    // leaves on the bottom level, then each round halves the vine
+    size_t full = 1;
+    while (full * 2 + 1 <= n) full = full * 2 + 1;
+    size_t rounds[64];
+    int count = 0;
+    rounds[count++] = n - full;
+    for (size_t m = full; m > 1; m /= 2) rounds[count++] = m / 2;
+    for (int r = 0; r < count; r++) {
+        node = top;
+        for (size_t i = 0; i < rounds[r]; i++) {
+            Node<Key, Value>* red = node->getRight();
+            rotateUp(red);
+            if (i == 0) top = red;
+            node = red->getRight();
+        }
+    }
+    return top;
+}
+
+/**
+* Counts the nodes of the subtree at top without recursing.
+*/
+template<typename Key, typename Value>
+size_t BinarySearchTree<Key, Value>::subtreeSize(Node<Key, Value>* top)
+{
+    if (top == nullptr) return 0;
+    size_t count = 0;
+    Node<Key, Value>* node = top;
+    Node<Key, Value>* from = top->getParent();
+    while (node != top->getParent()) {
+        if (from == node->getParent()) {
+            count++;
+            if (node->getLeft() != nullptr) {
+                from = node;
+                node = node->getLeft();
+                continue;
+            }
+        }
+        if (node->getRight() != nullptr && from != node->getRight()) {
+            from = node;
+            node = node->getRight();
+            continue;
+        }
+        from = node;
+        node = node->getParent();
+    }
+    return count;
+}
+
+/**
+* The auto-rebalance check after linking a new node (see
+* setAutoRebalance()). Costs a climb to the root when enabled and
+* nothing otherwise.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::checkDepth(Node<Key, Value>* inserted)
+{
+    if (autoRebalance_ == 0) return;
+    int depth = 0;
+    for (Node<Key, Value>* node = inserted; node->getParent() != nullptr; node = node->getParent()) {
+        depth++;
+    }
+    if (depth <= autoRebalance_ * std::log2((double)size_)) return;
+
+    const double alpha = std::pow(2.0, -1.0 / autoRebalance_);
+    Node<Key, Value>* child = inserted;
+    size_t childSize = 1;
+    while (child->getParent() != nullptr) {
+        Node<Key, Value>* parent = child->getParent();
+        Node<Key, Value>* sibling = parent->getLeft() == child ? parent->getRight() : parent->getLeft();
+        size_t parentSize = childSize + 1 + subtreeSize(sibling);
+        if (childSize > alpha * parentSize) {
+            rebuild(parent);
+            return;
+        }
+        child = parent;
+        childSize = parentSize;
+    }
+}
+
 /**
  * Return true iff the BST is balanced.
  */
@@ -696,6 +2479,7 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
     }
+    BST_STAT(stats_.nodeSwaps++);
     Node<Key, Value>* n1p = n1->getParent();
     Node<Key, Value>* n1r = n1->getRight();
     Node<Key, Value>* n1lt = n1->getLeft();
@@ -776,6 +2560,26 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
 
 
 
+/**
+* Swaps two plain trees in O(1); see BinarySearchTree::swap().
+*/
+template<typename Key, typename Value>
+void swap(BinarySearchTree<Key, Value>& a, BinarySearchTree<Key, Value>& b)
+{
+    a.swap(b);
+}
+
+/**
+* Chosen over the swap() above when the trees are of different types,
+* which would trade nodes of one kind into a tree of another.
+*/
+template<typename Tree1, typename Tree2>
+typename std::enable_if<!std::is_same<Tree1, Tree2>::value &&
+    std::is_base_of<BinarySearchTree<typename Tree1::key_type, typename Tree1::mapped_type>, Tree1>::value &&
+    std::is_base_of<BinarySearchTree<typename Tree2::key_type, typename Tree2::mapped_type>, Tree2>::value>::type
+swap(Tree1& a, Tree2& b) = delete;
+
+
 /**
  * Lastly, we are providing you with a print function,
    BinarySearchTree::printRoot().
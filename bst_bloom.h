@@ -0,0 +1,184 @@
+#ifndef BST_BLOOM_H
+#define BST_BLOOM_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+/**
+* A blocked Bloom filter over the keys of a search tree, checked before
+* a lookup descends (see BinarySearchTree::setBloomFilter()). Each key
+* sets BLOOM_PROBES bits in one 64-byte block, so a query touches one
+* cache line; a "no" means the key is certainly absent.
+*
+* Bloom filters cannot forget, so removed keys stay set. The filter
+* counts them and the tree rebuilds it from its contents once they make
+* up too large a share, or once more keys were added than it was sized
+* for. As with NodeHashIndex, the hash is a plain function pointer.
+*
+* The bits only depend on the keys, so a copy of the tree copies the
+* filter as it is.
+*/
+template<typename Key>
+class KeyBloomFilter
+{
+public:
+    typedef size_t (*HashFn)(const Key&);
+
+    KeyBloomFilter() :
+        hash_(nullptr), bitsPerKey_(0), staleFraction_(0), blocks_(0), bits_(nullptr),
+        capacity_(0), added_(0), removed_(0)
+    {
+
+    }
+
+    // The copy gets its own cache-line aligned blocks, which may start
+    // at a different offset into its storage.
+    KeyBloomFilter(const KeyBloomFilter& other) :
+        hash_(other.hash_), bitsPerKey_(other.bitsPerKey_), staleFraction_(other.staleFraction_),
+        blocks_(other.blocks_), bits_(nullptr), capacity_(other.capacity_), added_(other.added_),
+        removed_(other.removed_)
+    {
+        if (other.bits_ != nullptr) {
+            align(blocks_);
+            memcpy(bits_, other.bits_, blocks_ * 8 * sizeof(uint64_t));
+        }
+    }
+
+    KeyBloomFilter(KeyBloomFilter&& other) : KeyBloomFilter()
+    {
+        swap(other);
+    }
+
+    KeyBloomFilter& operator=(KeyBloomFilter other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    // Swapping the vectors keeps each buffer, so bits_ stays valid.
+    void swap(KeyBloomFilter& other)
+    {
+        std::swap(hash_, other.hash_);
+        std::swap(bitsPerKey_, other.bitsPerKey_);
+        std::swap(staleFraction_, other.staleFraction_);
+        storage_.swap(other.storage_);
+        std::swap(blocks_, other.blocks_);
+        std::swap(bits_, other.bits_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(added_, other.added_);
+        std::swap(removed_, other.removed_);
+    }
+
+    bool enabled() const
+    {
+        return hash_ != nullptr;
+    }
+
+    void enable(HashFn hash, double bitsPerKey, double staleFraction)
+    {
+        hash_ = hash;
+        bitsPerKey_ = bitsPerKey;
+        staleFraction_ = staleFraction;
+    }
+
+    void disable()
+    {
+        hash_ = nullptr;
+        std::vector<uint64_t>().swap(storage_);
+        bits_ = nullptr;
+        blocks_ = capacity_ = added_ = removed_ = 0;
+    }
+
+    // Empties the filter and sizes it for twice expected keys, so the
+    // false positive rate stays at or below the nominal one until
+    // needsRebuild().
+    void reset(size_t expected)
+    {
+        capacity_ = 2 * (expected < 512 ? 512 : expected);
+        blocks_ = (size_t)(capacity_ * bitsPerKey_ / 512) + 1;
+        align(blocks_);
+        added_ = removed_ = 0;
+    }
+
+    void add(const Key& key)
+    {
+        uint64_t h = mix(hash_(key));
+        uint64_t* block = bits_ + blockOf(h);
+        uint64_t probe = h * 0x9e3779b97f4a7c15ULL;
+        for (int i = 0; i < BLOOM_PROBES; i++, probe <<= 9) {
+            unsigned bit = (unsigned)(probe >> 55);
+            block[bit >> 6] |= 1ULL << (bit & 63);
+        }
+        added_++;
+    }
+
+    bool mayContain(const Key& key) const
+    {
+        uint64_t h = mix(hash_(key));
+        const uint64_t* block = bits_ + blockOf(h);
+        uint64_t probe = h * 0x9e3779b97f4a7c15ULL;
+        for (int i = 0; i < BLOOM_PROBES; i++, probe <<= 9) {
+            unsigned bit = (unsigned)(probe >> 55);
+            if ((block[bit >> 6] & (1ULL << (bit & 63))) == 0) return false;
+        }
+        return true;
+    }
+
+    // Notes that a key was removed from the tree.
+    void removed()
+    {
+        removed_++;
+    }
+
+    bool needsRebuild() const
+    {
+        return added_ > capacity_ || removed_ > staleFraction_ * added_;
+    }
+
+    size_t bytes() const
+    {
+        return storage_.capacity() * sizeof(uint64_t);
+    }
+
+private:
+    static const int BLOOM_PROBES = 6;     // 9-bit offsets from one 64-bit product
+
+    static uint64_t mix(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // Allocates zeroed storage for blocks with 8 spare words, to align
+    // the blocks to cache lines.
+    void align(size_t blocks)
+    {
+        storage_.assign(blocks * 8 + 8, 0);
+        uintptr_t address = (uintptr_t)&storage_[0];
+        bits_ = &storage_[0] + ((64 - address % 64) % 64) / 8;
+    }
+
+    // The offset of the block, picked by the high half of the hash. The
+    // probes come from the top bits of the whole hash times a constant.
+    size_t blockOf(uint64_t h) const
+    {
+        return 8 * (size_t)(((h >> 32) * blocks_) >> 32);
+    }
+
+    HashFn hash_;
+    double bitsPerKey_;
+    double staleFraction_;
+    std::vector<uint64_t> storage_;
+    size_t blocks_;
+    uint64_t* bits_;    // the first block, cache-line aligned
+    size_t capacity_;   // keys it was sized for
+    size_t added_;      // keys added since the last reset
+    size_t removed_;    // keys removed since the last reset
+};
+
+#endif
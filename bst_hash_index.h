@@ -0,0 +1,175 @@
+#ifndef BST_HASH_INDEX_H
+#define BST_HASH_INDEX_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/**
+* An open-addressing hash table from key to tree node, kept beside a
+* search tree so exact-key lookups skip the descent (see
+* BinarySearchTree::setHashIndex()). It only stores node pointers; the
+* tree owns the nodes and reports every node it links, unlinks or moves.
+*
+* The hash function is passed in as a plain function pointer. Trees over
+* keys without a std::hash never call enable(), so they still compile.
+*
+* Linear probing at a load factor of at most 3/4. Each slot keeps the
+* full hash next to the node, so probing past other keys does not touch
+* their nodes. Removal shifts later entries back instead of leaving
+* tombstones, so lookups never slow down under churn.
+*/
+template<typename Key, typename NodeT>
+class NodeHashIndex
+{
+public:
+    typedef size_t (*HashFn)(const Key&);
+
+    NodeHashIndex() : hash_(nullptr), used_(0), mask_(0)
+    {
+
+    }
+
+    bool enabled() const
+    {
+        return hash_ != nullptr;
+    }
+
+    HashFn hashFunction() const
+    {
+        return hash_;
+    }
+
+    // Starts indexing with the given hash, sized for expected nodes; the
+    // caller adds the nodes already in the tree.
+    void enable(HashFn hash, size_t expected)
+    {
+        hash_ = hash;
+        used_ = 0;
+        size_t capacity = 16;
+        while (capacity * 3 < expected * 4) capacity *= 2;
+        slots_.assign(capacity, Slot());
+        mask_ = capacity - 1;
+    }
+
+    // Stops indexing and frees the table.
+    void disable()
+    {
+        hash_ = nullptr;
+        used_ = 0;
+        mask_ = 0;
+        std::vector<Slot>().swap(slots_);
+    }
+
+    // Forgets every node but keeps the table and stays enabled.
+    void clear()
+    {
+        if (!enabled()) return;
+        slots_.assign(slots_.size(), Slot());
+        used_ = 0;
+    }
+
+    // @precondition no other indexed node has the same key
+    void add(NodeT* node)
+    {
+        if ((used_ + 1) * 4 > slots_.size() * 3) grow();
+        place(mix(hash_(node->getKey())), node);
+        used_++;
+    }
+
+    void remove(NodeT* node)
+    {
+        size_t i = slotOf(node);
+        if (i == slots_.size()) return;
+        // shift back each later entry of the run that may move closer to
+        // its home slot, so no lookup meets a hole before its key
+        size_t hole = i;
+        for (size_t j = (i + 1) & mask_; slots_[j].node != nullptr; j = (j + 1) & mask_) {
+            size_t home = slots_[j].hash & mask_;
+            if (((j - home) & mask_) >= ((j - hole) & mask_)) {
+                slots_[hole] = slots_[j];
+                hole = j;
+            }
+        }
+        slots_[hole] = Slot();
+        used_--;
+    }
+
+    // Points the entry for old at copy, which has the same key.
+    void replace(NodeT* old, NodeT* copy)
+    {
+        size_t i = slotOf(old);
+        if (i != slots_.size()) slots_[i].node = copy;
+    }
+
+    NodeT* find(const Key& key) const
+    {
+        size_t h = mix(hash_(key));
+        for (size_t i = h & mask_; slots_[i].node != nullptr; i = (i + 1) & mask_) {
+            if (slots_[i].hash == h && slots_[i].node->getKey() == key) return slots_[i].node;
+        }
+        return nullptr;
+    }
+
+    // Bytes used by the table.
+    size_t bytes() const
+    {
+        return slots_.capacity() * sizeof(Slot);
+    }
+
+private:
+    struct Slot
+    {
+        Slot() : hash(0), node(nullptr) { }
+        size_t hash;
+        NodeT* node;
+    };
+
+    // std::hash is the identity for integers, which would pile keys that
+    // share low bits into one run.
+    static size_t mix(size_t h)
+    {
+        uint64_t x = h;
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        return (size_t)x;
+    }
+
+    void place(size_t h, NodeT* node)
+    {
+        size_t i = h & mask_;
+        while (slots_[i].node != nullptr) i = (i + 1) & mask_;
+        slots_[i].hash = h;
+        slots_[i].node = node;
+    }
+
+    // The slot holding node, or slots_.size() if it is not indexed.
+    size_t slotOf(NodeT* node) const
+    {
+        size_t h = mix(hash_(node->getKey()));
+        for (size_t i = h & mask_; slots_[i].node != nullptr; i = (i + 1) & mask_) {
+            if (slots_[i].node == node) return i;
+        }
+        return slots_.size();
+    }
+
+    void grow()
+    {
+        // the bigger table is made first, so a failed allocation
+        // leaves the index as it was
+        std::vector<Slot> old(slots_.size() * 2, Slot());
+        old.swap(slots_);
+        mask_ = slots_.size() - 1;
+        for (size_t i = 0; i < old.size(); i++) {
+            if (old[i].node != nullptr) place(old[i].hash, old[i].node);
+        }
+    }
+
+    HashFn hash_;
+    std::vector<Slot> slots_;
+    size_t used_;
+    size_t mask_;
+};
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef BST_STATS_H
+#define BST_STATS_H
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Operation statistics for the search trees. Define BST_STATS when
+// compiling to turn them on; otherwise every BST_STAT()/BST_TIMED()
+// below expands to nothing and the trees carry no extra state, so
+// stats() just returns an empty snapshot.
+
+#ifdef BST_STATS
+#define BST_STAT(expr) do { expr; } while(0)
+#define BST_TIMED(histogram) BSTLatencyTimer bstLatencyTimer_(this->stats_.histogram)
+#else
+#define BST_STAT(expr) do { } while(0)
+#define BST_TIMED(histogram) do { } while(0)
+#endif
+
+/**
+* A latency histogram in the style of HdrHistogram: below 16ns every
+* value has its own bucket, and above that each power of two is split
+* into 16 linear sub-buckets, so recorded values keep ~6% precision
+* over the whole 64-bit range in under 1000 counters.
+*/
+class LatencyHistogram
+{
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int BUCKETS = SUB_COUNT + (64 - SUB_BITS) * SUB_COUNT;
+
+    LatencyHistogram();
+
+    void record(uint64_t ns);
+    uint64_t count() const;
+    uint64_t max() const;
+    double mean() const;
+    uint64_t percentile(double p) const;
+    void print(std::ostream& os, const char* name) const;
+
+private:
+    static int bucketOf(uint64_t ns);
+    static uint64_t bucketLow(int bucket);
+
+    uint64_t counts_[BUCKETS];
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+};
+
+inline LatencyHistogram::LatencyHistogram() : count_(0), sum_(0), max_(0)
+{
+    for(int i = 0; i < BUCKETS; i++) counts_[i] = 0;
+}
+
+inline int LatencyHistogram::bucketOf(uint64_t ns)
+{
+    if(ns < (uint64_t)SUB_COUNT) return (int)ns;
+    int msb = 63 - __builtin_clzll(ns);
+    int shift = msb - SUB_BITS;
+    return SUB_COUNT + shift * SUB_COUNT + (int)((ns >> shift) - SUB_COUNT);
+}
+
+inline uint64_t LatencyHistogram::bucketLow(int bucket)
+{
+    if(bucket < SUB_COUNT) return bucket;
+    int shift = (bucket - SUB_COUNT) / SUB_COUNT;
+    uint64_t mantissa = SUB_COUNT + (bucket - SUB_COUNT) % SUB_COUNT;
+    return mantissa << shift;
+}
+
+inline void LatencyHistogram::record(uint64_t ns)
+{
+    counts_[bucketOf(ns)]++;
+    count_++;
+    sum_ += ns;
+    if(ns > max_) max_ = ns;
+}
+
+inline uint64_t LatencyHistogram::count() const
+{
+    return count_;
+}
+
+inline uint64_t LatencyHistogram::max() const
+{
+    return max_;
+}
+
+inline double LatencyHistogram::mean() const
+{
+    return count_ == 0 ? 0.0 : (double)sum_ / count_;
+}
+
+/**
+* Returns the lower bound of the bucket holding the p-th percentile
+* (0 <= p <= 100).
+*/
+inline uint64_t LatencyHistogram::percentile(double p) const
+{
+    if(count_ == 0) return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * count_);
+    if(rank >= count_) rank = count_ - 1;
+    uint64_t seen = 0;
+    for(int i = 0; i < BUCKETS; i++) {
+        seen += counts_[i];
+        if(seen > rank) return bucketLow(i);
+    }
+    return max_;
+}
+
+inline void LatencyHistogram::print(std::ostream& os, const char* name) const
+{
+    os << std::left << std::setw(8) << name << std::right
+       << " count " << count_
+       << "  mean " << std::fixed << std::setprecision(1) << mean() << "ns"
+       << "  p50 " << percentile(50) << "ns"
+       << "  p99 " << percentile(99) << "ns"
+       << "  p99.9 " << percentile(99.9) << "ns"
+       << "  max " << max_ << "ns" << std::endl;
+}
+
+/**
+* Records the time from construction to destruction into a histogram.
+*/
+class BSTLatencyTimer
+{
+public:
+    explicit BSTLatencyTimer(LatencyHistogram& histogram) :
+        histogram_(histogram), start_(std::chrono::steady_clock::now())
+    {
+
+    }
+
+    ~BSTLatencyTimer()
+    {
+        histogram_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count());
+    }
+
+private:
+    LatencyHistogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+* A snapshot of a tree's operation counters and latency histograms.
+*/
+struct BSTStats
+{
+    BSTStats() :
+        lookups(0), filtered(0), comparisons(0), nodesVisited(0), rotations(0),
+        nodeSwaps(0), allocations(0), frees(0), nodeBytes(0)
+    {
+
+    }
+
+    uint64_t lookups;       // internalFind() calls
+    uint64_t filtered;      // lookups the Bloom filter answered alone
+    uint64_t comparisons;   // key comparisons made by those lookups
+    uint64_t nodesVisited;  // nodes visited by lookups and insert descents
+    uint64_t rotations;
+    uint64_t nodeSwaps;
+    uint64_t allocations;   // nodes allocated by the tree
+    uint64_t frees;         // nodes freed by the tree
+    size_t nodeBytes;       // sizeof one node of this tree
+
+    LatencyHistogram insertLatency;
+    LatencyHistogram findLatency;
+    LatencyHistogram removeLatency;
+
+    uint64_t liveNodes() const
+    {
+        return allocations - frees;
+    }
+
+    // Heap bytes per entry, assuming a malloc with 8 bytes of header
+    // and 16-byte granularity (as glibc does).
+    size_t bytesPerEntry() const
+    {
+        return nodeBytes == 0 ? 0 : (nodeBytes + 8 + 15) / 16 * 16;
+    }
+
+    double comparisonsPerLookup() const
+    {
+        return lookups == 0 ? 0.0 : (double)comparisons / lookups;
+    }
+
+    void allocated(size_t bytes)
+    {
+        allocations++;
+        nodeBytes = bytes;
+    }
+
+    void print(std::ostream& os) const
+    {
+        os << "lookups " << lookups
+           << "  filtered " << filtered
+           << "  comparisons/lookup " << std::fixed << std::setprecision(2) << comparisonsPerLookup()
+           << "  nodes visited " << nodesVisited
+           << "  rotations " << rotations
+           << "  nodeSwaps " << nodeSwaps << std::endl;
+        os << "allocations " << allocations
+           << "  frees " << frees
+           << "  live nodes " << liveNodes()
+           << "  bytes/entry " << bytesPerEntry() << std::endl;
+        insertLatency.print(os, "insert");
+        findLatency.print(os, "find");
+        removeLatency.print(os, "remove");
+    }
+};
+
+/**
+* The shape of a tree at one moment, as computed by shapeStats(). Depths
+* count nodes, so the root is at depth 1 and a lookup that finds a key at
+* depth d visits d nodes.
+*/
+struct ShapeStats
+{
+    ShapeStats() :
+        nodes(0), leaves(0), height(0), maxDepth(0), averageDepth(0.0),
+        unbalancedNodes(0), comparisonsPerHit(0.0)
+    {
+
+    }
+
+    size_t nodes;
+    size_t leaves;
+    int height;                     // levels; 0 for an empty tree
+    int maxDepth;                   // same as height, kept for symmetry with averageDepth
+    double averageDepth;            // over all nodes
+    size_t unbalancedNodes;         // nodes whose subtree heights differ by more than 1
+    double comparisonsPerHit;       // expected key comparisons of a successful find()
+    std::vector<size_t> leafDepths; // leafDepths[d] = number of leaves at depth d
+
+    void print(std::ostream& os) const
+    {
+        os << "nodes " << nodes << "  leaves " << leaves << "  height " << height
+           << "  average depth " << std::fixed << std::setprecision(2) << averageDepth
+           << "  unbalanced nodes " << unbalancedNodes
+           << "  comparisons/hit " << comparisonsPerHit << std::endl;
+        os << "leaf depths:";
+        for(size_t d = 0; d < leafDepths.size(); d++) {
+            if(leafDepths[d] > 0) os << " " << d << ":" << leafDepths[d];
+        }
+        os << std::endl;
+    }
+};
+
+#endif
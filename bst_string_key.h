@@ -0,0 +1,105 @@
+#ifndef BST_STRING_KEY_H
+#define BST_STRING_KEY_H
+
+#include <iostream>
+#include <string>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+/**
+* A string key that also keeps its first 8 bytes as a big-endian integer.
+* The trees store keys inline in their nodes, so with this key type
+* (e.g. AVLTree<PrefixedString, Value>) a comparison that the prefixes
+* decide never touches the string's heap buffer: one cache miss per
+* level instead of two. Orders exactly like std::string.
+*
+* The prefix only helps if keys differ within their first 8 bytes, so
+* strip parts every key shares first, e.g. the "https://" of a URL.
+*/
+class PrefixedString
+{
+public:
+    PrefixedString() : prefix_(0)
+    {
+
+    }
+
+    PrefixedString(const std::string& str) : prefix_(prefixOf(str)), str_(str)
+    {
+
+    }
+
+    PrefixedString(const char* str) : str_(str)
+    {
+        prefix_ = prefixOf(str_);
+    }
+
+    const std::string& str() const
+    {
+        return str_;
+    }
+
+    uint64_t prefix() const
+    {
+        return prefix_;
+    }
+
+    friend bool operator<(const PrefixedString& a, const PrefixedString& b)
+    {
+        if(a.prefix_ != b.prefix_) return a.prefix_ < b.prefix_;
+        return a.str_ < b.str_;
+    }
+
+    friend bool operator==(const PrefixedString& a, const PrefixedString& b)
+    {
+        return a.prefix_ == b.prefix_ && a.str_ == b.str_;
+    }
+
+    friend bool operator!=(const PrefixedString& a, const PrefixedString& b)
+    {
+        return !(a == b);
+    }
+
+    friend bool operator>(const PrefixedString& a, const PrefixedString& b)
+    {
+        return b < a;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const PrefixedString& key)
+    {
+        return os << key.str_;
+    }
+
+private:
+    // Shorter strings are padded with zero bytes, which sorts "ab" before
+    // "abc" as std::string does; keys whose prefixes tie (including
+    // "a" and "a\0") fall back to comparing the strings.
+    static uint64_t prefixOf(const std::string& str)
+    {
+        uint64_t prefix = 0;
+        for(size_t i = 0; i < 8; i++) {
+            unsigned char c = i < str.size() ? (unsigned char)str[i] : 0;
+            prefix = (prefix << 8) | c;
+        }
+        return prefix;
+    }
+
+    uint64_t prefix_;
+    std::string str_;
+};
+
+namespace std {
+
+template<>
+struct hash<PrefixedString>
+{
+    size_t operator()(const PrefixedString& key) const
+    {
+        return hash<string>()(key.str());
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,295 @@
+#ifndef BST_TRACE_H
+#define BST_TRACE_H
+
+#include <iostream>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Binary traces of the operations a service performs on a search tree,
+// so they can be replayed offline against other engines (see
+// bst-replay.cpp). Keys must be integral; values are not recorded.
+//
+// Format: the 8-byte magic "BSTTRC1\n", then one record per operation:
+//   1 byte  opcode (TRACE_INSERT, TRACE_FIND, TRACE_REMOVE, TRACE_ITERATE)
+//   varint  key, zigzag-encoded as the difference from the previous key
+//   varint  number of ++ steps             (TRACE_ITERATE only)
+// An iterate record whose opcode has TRACE_FROM_BEGIN set starts at
+// begin() and stores no key. Nearly sorted keys cost 2-3 bytes a record.
+// Signed keys are stored with the sign bit flipped (see traceKey()), so
+// recorded keys compare as unsigned in the same order as the originals.
+
+enum TraceOpcode {
+    TRACE_INSERT = 1,
+    TRACE_FIND = 2,
+    TRACE_REMOVE = 3,
+    TRACE_ITERATE = 4,
+    TRACE_FROM_BEGIN = 0x80
+};
+
+static const char TRACE_MAGIC[8] = { 'B', 'S', 'T', 'T', 'R', 'C', '1', '\n' };
+
+struct TraceOp
+{
+    uint8_t opcode;     // without TRACE_FROM_BEGIN
+    bool fromBegin;
+    uint64_t key;
+    uint64_t steps;
+};
+
+/**
+* How keys are disguised before they are written. SHIFT adds a secret
+* offset, which keeps the key order (and so the tree shape) intact as
+* long as no key wraps past UINT64_MAX; the writer throws rather than
+* wrap, so the secret must leave room above the largest key. HASH
+* applies a keyed bijective mix, which hides more but keeps only key
+* equality, so replayed trees get a different shape.
+*/
+enum TraceAnonymize { ANONYMIZE_NONE, ANONYMIZE_SHIFT, ANONYMIZE_HASH };
+
+/**
+* Maps an integral key to the 64-bit key a trace stores, keeping the
+* order: unsigned keys are unchanged, and signed ones are offset by 2^63
+* (the sign bit flipped) so negative keys come before positive ones.
+*/
+template<typename Key>
+uint64_t traceKey(const Key& key)
+{
+    if(std::is_signed<Key>::value) {
+        return (uint64_t)(int64_t)key ^ (1ULL << 63);
+    }
+    return (uint64_t)key;
+}
+
+/**
+* Encodes trace records into a stream. The keys are traceKey() values.
+*/
+class TraceWriter
+{
+public:
+    TraceWriter(std::ostream& out, TraceAnonymize mode = ANONYMIZE_NONE, uint64_t secret = 0) :
+        out_(out), mode_(mode), secret_(secret), prevKey_(0), records_(0)
+    {
+        out_.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    }
+
+    // Throws std::overflow_error, writing nothing, if SHIFT would wrap
+    // the key.
+    void write(uint8_t opcode, uint64_t key)
+    {
+        key = anonymize(key);
+        out_.put((char)opcode);
+        writeKey(key);
+        records_++;
+    }
+
+    void writeIterate(bool fromBegin, uint64_t key, uint64_t steps)
+    {
+        if(fromBegin) {
+            out_.put((char)(TRACE_ITERATE | TRACE_FROM_BEGIN));
+        }
+        else {
+            key = anonymize(key);
+            out_.put((char)TRACE_ITERATE);
+            writeKey(key);
+        }
+        writeVarint(steps);
+        records_++;
+    }
+
+    uint64_t records() const
+    {
+        return records_;
+    }
+
+private:
+    uint64_t anonymize(uint64_t key) const
+    {
+        if(mode_ == ANONYMIZE_SHIFT) {
+            if(key > UINT64_MAX - secret_) {
+                throw std::overflow_error("TraceWriter: shifted key wraps past UINT64_MAX");
+            }
+            return key + secret_;
+        }
+        if(mode_ == ANONYMIZE_HASH) {
+            // every step is invertible, so distinct keys stay distinct
+            key ^= secret_;
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdULL;
+            key ^= key >> 33;
+            key *= 0xc4ceb9fe1a85ec53ULL;
+            key ^= key >> 33;
+        }
+        return key;
+    }
+
+    void writeKey(uint64_t key)
+    {
+        int64_t delta = (int64_t)(key - prevKey_);
+        prevKey_ = key;
+        writeVarint(((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+    }
+
+    void writeVarint(uint64_t v)
+    {
+        while(v >= 0x80) {
+            out_.put((char)(v | 0x80));
+            v >>= 7;
+        }
+        out_.put((char)v);
+    }
+
+    std::ostream& out_;
+    TraceAnonymize mode_;
+    uint64_t secret_;
+    uint64_t prevKey_;
+    uint64_t records_;
+};
+
+/**
+* Decodes trace records from a stream.
+*/
+class TraceReader
+{
+public:
+    explicit TraceReader(std::istream& in) : in_(in), prevKey_(0), valid_(false)
+    {
+        char magic[sizeof(TRACE_MAGIC)];
+        in_.read(magic, sizeof(magic));
+        valid_ = in_.gcount() == (std::streamsize)sizeof(magic) &&
+                 std::string(magic, sizeof(magic)) == std::string(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    }
+
+    // False if the stream does not start with a trace header.
+    bool valid() const
+    {
+        return valid_;
+    }
+
+    // Reads the next record; returns false at the end of the trace or on
+    // a truncated or unknown record.
+    bool next(TraceOp& op)
+    {
+        if(!valid_) return false;
+        int c = in_.get();
+        if(c == EOF) return false;
+        op.fromBegin = (c & TRACE_FROM_BEGIN) != 0;
+        op.opcode = (uint8_t)(c & ~TRACE_FROM_BEGIN);
+        op.key = 0;
+        op.steps = 0;
+        if(op.opcode < TRACE_INSERT || op.opcode > TRACE_ITERATE) return false;
+        if(!op.fromBegin && !readKey(op.key)) return false;
+        if(op.opcode == TRACE_ITERATE && !readVarint(op.steps)) return false;
+        return true;
+    }
+
+private:
+    bool readKey(uint64_t& key)
+    {
+        uint64_t zz;
+        if(!readVarint(zz)) return false;
+        int64_t delta = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+        prevKey_ += (uint64_t)delta;
+        key = prevKey_;
+        return true;
+    }
+
+    bool readVarint(uint64_t& v)
+    {
+        v = 0;
+        for(int shift = 0; shift < 64; shift += 7) {
+            int c = in_.get();
+            if(c == EOF) return false;
+            v |= (uint64_t)(c & 0x7f) << shift;
+            if((c & 0x80) == 0) return true;
+        }
+        return false;
+    }
+
+    std::istream& in_;
+    uint64_t prevKey_;
+    bool valid_;
+};
+
+/**
+* Forwards calls to a tree (usually an AVLTree) and records each one
+* in a trace. Use the recorder in place of the tree in the code whose
+* traffic should be captured. Updates are recorded before they reach
+* the tree, so one the writer rejects leaves the tree unchanged.
+*/
+template<typename Tree>
+class TraceRecorder
+{
+public:
+    typedef typename Tree::iterator iterator;
+    // the tree's key type, which decides how traceKey() maps a key
+    typedef typename std::decay<decltype(std::declval<iterator&>()->first)>::type key_type;
+
+    TraceRecorder(Tree& tree, std::ostream& out, TraceAnonymize mode = ANONYMIZE_NONE, uint64_t secret = 0) :
+        tree_(tree), writer_(out, mode, secret)
+    {
+
+    }
+
+    template<typename Item>
+    void insert(const Item& keyValuePair)
+    {
+        writer_.write(TRACE_INSERT, traceKey<key_type>(keyValuePair.first));
+        tree_.insert(keyValuePair);
+    }
+
+    template<typename Key>
+    void remove(const Key& key)
+    {
+        writer_.write(TRACE_REMOVE, traceKey<key_type>(key));
+        tree_.remove(key);
+    }
+
+    template<typename Key>
+    iterator find(const Key& key)
+    {
+        writer_.write(TRACE_FIND, traceKey<key_type>(key));
+        return tree_.find(key);
+    }
+
+    iterator end() const
+    {
+        return tree_.end();
+    }
+
+    // Calls fn on every item in order.
+    template<typename Fn>
+    void iterate(Fn fn)
+    {
+        uint64_t steps = 0;
+        for(iterator it = tree_.begin(); it != tree_.end(); ++it, ++steps) {
+            fn(*it);
+        }
+        writer_.writeIterate(true, 0, steps);
+    }
+
+    // Calls fn on at most count items, starting at key (if present).
+    template<typename Key, typename Fn>
+    void iterateFrom(const Key& key, uint64_t count, Fn fn)
+    {
+        uint64_t steps = 0;
+        for(iterator it = tree_.find(key); it != tree_.end() && steps < count; ++it, ++steps) {
+            fn(*it);
+        }
+        writer_.writeIterate(false, traceKey<key_type>(key), steps);
+    }
+
+    uint64_t records() const
+    {
+        return writer_.records();
+    }
+
+private:
+    Tree& tree_;
+    TraceWriter writer_;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include "equal-paths.h"
+#include "equal-paths-parallel.h"
+#include "bench_util.h"
+using namespace std;
+
+// Times equalPaths() and equalPathsParallel() on large trees, against
+// the original two-pass recursive version. Each run is forked (see
+// isolated()), so the recursive version overflowing the stack on a
+// chain shows up as a crashed run instead of ending the benchmark.
+//
+//   equal-paths-bench [log2 size] [threads]
+
+// The original implementation: the depth of the leftmost leaf, then a
+// recursive check of every path against it.
+static int findHeight(Node* root)
+{
+    if (root->left == nullptr && root->right == nullptr) return 0;
+    return 1 + findHeight(root->left != nullptr ? root->left : root->right);
+}
+
+static bool checkEqualPaths(Node* root, int height, int pathLength)
+{
+    if (root == nullptr) return true;
+    if (root->left == nullptr && root->right == nullptr) return pathLength == height;
+    return checkEqualPaths(root->left, height, pathLength + 1) &&
+           checkEqualPaths(root->right, height, pathLength + 1);
+}
+
+static bool recursiveEqualPaths(Node* root)
+{
+    return root == nullptr || checkEqualPaths(root, findHeight(root), 0);
+}
+
+// Builds one of the benchmark trees out of n nodes (n + 1 for "late"):
+//   perfect  a complete tree with all leaves on the last level (true)
+//   early    perfect, but the leftmost leaf's parent loses both children (false at once)
+//   late     perfect, plus one node under its rightmost leaf (false at the end)
+//   chain    every node the left child of the one before (true)
+static Node* build(const string& shape, vector<Node*>& nodes, size_t n)
+{
+    for(size_t i = 0; i < n; i++) nodes.push_back(new Node((int)i));
+    if(shape == "chain") {
+        for(size_t i = 0; i + 1 < n; i++) nodes[i]->left = nodes[i + 1];
+        return nodes[0];
+    }
+    for(size_t i = 0; 2 * i + 2 < n; i++) {
+        nodes[i]->left = nodes[2 * i + 1];
+        nodes[i]->right = nodes[2 * i + 2];
+    }
+    if(shape == "early") {
+        size_t leaf = 0;
+        while(nodes[leaf]->left != nullptr) leaf = 2 * leaf + 1;
+        nodes[(leaf - 1) / 2]->left = nullptr;
+        nodes[(leaf - 1) / 2]->right = nullptr;
+    }
+    else if(shape == "late") {
+        nodes.push_back(new Node((int)n));
+        nodes[n - 1]->left = nodes[n];
+    }
+    return nodes[0];
+}
+
+template<typename Check>
+static void run(const string& shape, size_t n, const string& name, Check check)
+{
+    bool ok = isolated([&]() {
+        vector<Node*> nodes;
+        Node* root = build(shape, nodes, n);
+        uint64_t start = nowNs();
+        bool result = check(root);
+        uint64_t elapsed = nowNs() - start;
+        cout << left << setw(10) << shape << setw(12) << name << right << setw(12) << n
+             << setw(8) << (result ? "true" : "false") << setw(12) << fixed << setprecision(2)
+             << elapsed / 1e6 << endl;
+        // the process exits right after, so the nodes are not freed
+        return true;
+    });
+    if(!ok) {
+        cout << left << setw(10) << shape << setw(12) << name << right << setw(12) << n
+             << setw(8) << "-" << setw(12) << "crashed" << endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int lg = argc > 1 ? atoi(argv[1]) : 22;
+    unsigned threads = argc > 2 ? atoi(argv[2]) : 0;
+    size_t n = ((size_t)1 << lg) - 1;
+
+    cout << left << setw(10) << "tree" << setw(12) << "version" << right << setw(12) << "n"
+         << setw(8) << "result" << setw(12) << "ms" << endl;
+    const char* shapes[] = { "perfect", "early", "late", "chain" };
+    for(int s = 0; s < 4; s++) {
+        run(shapes[s], n, "recursive", recursiveEqualPaths);
+        run(shapes[s], n, "iterative", equalPaths);
+        run(shapes[s], n, "parallel", [threads](Node* root) { return equalPathsParallel(root, threads); });
+    }
+    return 0;
+}
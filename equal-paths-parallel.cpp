@@ -0,0 +1,146 @@
+#include <vector>
+#include <deque>
+#include <utility>
+#include <thread>
+#include <atomic>
+
+#include "equal-paths-parallel.h"
+using namespace std;
+
+namespace {
+
+// Shared by the threads checking one tree.
+struct SharedCheck
+{
+    atomic<int> leafDepth;   // -1 until the first leaf is seen
+    atomic<bool> failed;
+};
+
+// Checks a leaf's depth against the shared one, setting it if this is
+// the first leaf. Returns false on a mismatch.
+bool checkLeaf(SharedCheck& shared, int depth)
+{
+    int expected = shared.leafDepth.load(memory_order_relaxed);
+    if (expected == -1 &&
+        shared.leafDepth.compare_exchange_strong(expected, depth, memory_order_relaxed)) {
+        return true;
+    }
+    return expected == depth;
+}
+
+// The iterative walk of equalPaths(), over one subtree whose root is at
+// the given depth. Polls the shared failure flag every few thousand
+// nodes so the other threads can stop early.
+bool checkSubtree(Node* root, int rootDepth, SharedCheck& shared)
+{
+    vector<pair<Node*, int> > pending;
+    Node* node = root;
+    int depth = rootDepth;
+    unsigned visited = 0;
+    while (true) {
+        if (++visited % 4096 == 0 && shared.failed.load(memory_order_relaxed)) {
+            return false;
+        }
+        if (node->left == nullptr && node->right == nullptr) {
+            if (!checkLeaf(shared, depth)) {
+                return false;
+            }
+            if (pending.empty()) {
+                break;
+            }
+            node = pending.back().first;
+            depth = pending.back().second;
+            pending.pop_back();
+            continue;
+        }
+        int leafDepth = shared.leafDepth.load(memory_order_relaxed);
+        if (leafDepth != -1 && depth >= leafDepth) {
+            return false;
+        }
+        if (node->left == nullptr) {
+            node = node->right;
+        }
+        else {
+            if (node->right != nullptr) {
+                pending.push_back(make_pair(node->right, depth + 1));
+            }
+            node = node->left;
+        }
+        depth++;
+    }
+    return true;
+}
+
+}
+
+bool equalPathsParallel(Node * root, unsigned threads)
+{
+    if (root == nullptr) {
+        return true;
+    }
+    if (threads == 0) {
+        threads = thread::hardware_concurrency();
+        if (threads == 0) {
+            threads = 1;
+        }
+    }
+
+    SharedCheck shared;
+    shared.leafDepth = -1;
+    shared.failed = false;
+
+    // Split the top of the tree breadth-first until there are several
+    // subtrees per thread, so an uneven tree still keeps them all busy.
+    // Leaves met on the way are checked here.
+    // The split gives up after a bounded number of nodes, so a long chain
+    // at the top goes to the threads instead of being walked here.
+    const size_t wanted = 8 * threads;
+    size_t budget = 64 * wanted;
+    deque<pair<Node*, int> > frontier;
+    frontier.push_back(make_pair(root, 0));
+    while (!frontier.empty() && frontier.size() < wanted && budget-- > 0) {
+        Node* node = frontier.front().first;
+        int depth = frontier.front().second;
+        frontier.pop_front();
+        if (node->left == nullptr && node->right == nullptr) {
+            if (!checkLeaf(shared, depth)) {
+                return false;
+            }
+            continue;
+        }
+        if (node->left != nullptr) {
+            frontier.push_back(make_pair(node->left, depth + 1));
+        }
+        if (node->right != nullptr) {
+            frontier.push_back(make_pair(node->right, depth + 1));
+        }
+    }
+    if (frontier.empty()) {
+        return true;
+    }
+
+    // The pool: each thread takes the next unchecked subtree until none
+    // are left or one of them fails.
+    atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t i;
+        while (!shared.failed.load(memory_order_relaxed) &&
+               (i = next.fetch_add(1, memory_order_relaxed)) < frontier.size()) {
+            if (!checkSubtree(frontier[i].first, frontier[i].second, shared)) {
+                shared.failed = true;
+            }
+        }
+    };
+    if (threads > frontier.size()) {
+        threads = frontier.size();
+    }
+    vector<thread> pool;
+    for (unsigned t = 1; t < threads; t++) {
+        pool.push_back(thread(worker));
+    }
+    worker();
+    for (size_t t = 0; t < pool.size(); t++) {
+        pool[t].join();
+    }
+    return !shared.failed;
+}
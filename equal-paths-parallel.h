@@ -0,0 +1,18 @@
+#ifndef EQUAL_PATHS_PARALLEL_H
+#define EQUAL_PATHS_PARALLEL_H
+
+#include "equal-paths.h"
+
+/**
+ * @brief Same result as equalPaths(), but for very large trees: the top
+ *        of the tree is split into independent subtrees, which a pool of
+ *        threads checks concurrently. The first leaf found by any thread
+ *        fixes the expected depth, and every thread stops as soon as one
+ *        finds a contradiction.
+ *
+ * @param root Pointer to the root of the tree to check for equal paths
+ * @param threads Number of threads to use, or 0 for one per hardware thread
+ */
+bool equalPathsParallel(Node * root, unsigned threads = 0);
+
+#endif
@@ -1,6 +1,10 @@
 #include <iostream>
 #include <cstdlib>
 #include "equal-paths.h"
+#include "equal-paths-parallel.h"
+#include "tree-validate.h"
+#include <sstream>
+#include <queue>
 using namespace std;
 
 
@@ -55,6 +59,114 @@ void test5(const char* msg)
   cout << msg << ": " <<   equalPaths(a) << endl;
 }
 
+// A chain deep enough to overflow a recursive check
+void test6(const char* msg)
+{
+  const int n = 1000000;
+  Node** chain = new Node*[n];
+  for(int i = n - 1; i >= 0; i--) {
+    chain[i] = new Node(i, i + 1 < n ? chain[i + 1] : NULL);
+  }
+  cout << msg << ": " << equalPaths(chain[0]) << " " << equalPathsParallel(chain[0], 4) << endl;
+  for(int i = 0; i < n; i++) delete chain[i];
+  delete [] chain;
+}
+
+// A perfect tree of 2^16 - 1 nodes, then with one leaf cut off at the
+// far right, checked by both versions
+void test7(const char* msg)
+{
+  const int n = (1 << 16) - 1;
+  Node** nodes = new Node*[n];
+  for(int i = n - 1; i >= 0; i--) {
+    nodes[i] = new Node(i, 2 * i + 1 < n ? nodes[2 * i + 1] : NULL, 2 * i + 2 < n ? nodes[2 * i + 2] : NULL);
+  }
+  cout << msg << ": " << equalPaths(nodes[0]) << " " << equalPathsParallel(nodes[0], 4);
+  nodes[(n - 2) / 2]->right = NULL;
+  nodes[(n - 2) / 2]->left = NULL;
+  cout << " " << equalPaths(nodes[0]) << " " << equalPathsParallel(nodes[0], 4) << endl;
+  for(int i = 0; i < n; i++) delete nodes[i];
+  delete [] nodes;
+}
+
+void writePreorder(ostream& out, Node* n)
+{
+  if(n == NULL) {
+    out << "# ";
+    return;
+  }
+  out << n->key << " ";
+  writePreorder(out, n->left);
+  writePreorder(out, n->right);
+}
+
+void writeLevelOrder(ostream& out, Node* root)
+{
+  queue<Node*> q;
+  q.push(root);
+  while(!q.empty()) {
+    Node* n = q.front();
+    q.pop();
+    if(n == NULL) {
+      out << "null,";
+      continue;
+    }
+    out << n->key << ",";
+    q.push(n->left);
+    q.push(n->right);
+  }
+}
+
+// Prints equalPaths() and what both streaming validators decide for the
+// same tree, plus the validators' heights
+void validateTest(const char* msg, Node* root)
+{
+  stringstream pre, level;
+  writePreorder(pre, root);
+  writeLevelOrder(level, root);
+  TreeReport p = validatePreorder(pre);
+  TreeReport l = validateLevelOrder(level);
+  cout << msg << ": " << equalPaths(root) << " " << p.equalPaths << " " << l.equalPaths
+       << " height " << p.height << " " << l.height
+       << (p.wellFormed && l.wellFormed ? "" : " malformed") << endl;
+}
+
+// Dumps that are malformed or out of order
+void badDumpTest(const char* msg)
+{
+  const char* preorder[] = { "2 1 # #", "2 1 # # 3 # # 4", "2 x # #", "2 3 # # 1 # #", "2 1 # # 2 # #" };
+  cout << msg << ":";
+  for(int i = 0; i < 5; i++) {
+    stringstream in(preorder[i]);
+    TreeReport r = validatePreorder(in);
+    cout << " " << r.wellFormed << r.ordered;
+  }
+  const char* level[] = { "2 1 3", "2 1 3 # # # # 4", "2 1 # 3 #" };
+  for(int i = 0; i < 3; i++) {
+    stringstream in(level[i]);
+    TreeReport r = validateLevelOrder(in);
+    cout << " " << r.wellFormed << r.equalPaths;
+  }
+  cout << endl;
+}
+
+// Keys at and just past the ends of long long: the ones that fit are
+// read and kept in order, the others spoil the dump
+void keyRangeTest(const char* msg)
+{
+  const char* preorder[] = { "1000000000000000000 # #", "9223372036854775807 # #", "-9223372036854775808 # #",
+                             "0 -9223372036854775808 # # 9223372036854775807 # #", "00009223372036854775807 # #",
+                             "9223372036854775808 # #", "-9223372036854775809 # #", "99999999999999999999 # #" };
+  cout << msg << ":";
+  for(int i = 0; i < 8; i++) {
+    stringstream in(preorder[i]);
+    TreeReport r = validatePreorder(in);
+    cout << " " << r.wellFormed << r.ordered;
+  }
+  stringstream in("-9223372036854775808 -9223372036854775807");
+  cout << " " << validateLevelOrder(in).wellFormed << endl;
+}
+
 int main()
 {
   a = new Node(1);
@@ -67,6 +179,30 @@ int main()
   test3("Test3");
   test4("Test4");
   test5("Test5");
+  test6("Test6");
+  test7("Test7");
+
+  // the small trees again, through the parallel version
+  setNode(a,1,b,c);
+  setNode(b,2,NULL,d);
+  setNode(c,3,NULL,NULL);
+  setNode(d,4,NULL,NULL);
+  cout << "Parallel Test5: " << equalPathsParallel(a, 4) << endl;
+  setNode(b,2,NULL,NULL);
+  cout << "Parallel Test3: " << equalPathsParallel(a, 4) << endl;
+
+  // the small trees again, serialized and checked by the validators
+  setNode(a,1,NULL,NULL);
+  validateTest("Validate Test1", a);
+  setNode(a,1,b,NULL);
+  validateTest("Validate Test2", a);
+  setNode(a,1,b,c);
+  validateTest("Validate Test3", a);
+  setNode(b,2,NULL,d);
+  validateTest("Validate Test5", a);
+  validateTest("Validate empty", NULL);
+  badDumpTest("Bad dumps");
+  keyRangeTest("Key range");
  
   delete a;
   delete b;
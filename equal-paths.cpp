@@ -1,6 +1,9 @@
 #ifndef RECCHECK
 //if you want to add any #includes like <iostream> you must do them here (before the next endif)
 #include <iostream>
+#include <vector>
+#include <utility>
+#include <climits>
 #endif
 
 #include "equal-paths.h"
@@ -9,11 +12,6 @@ using namespace std;
 
 // You may add any prototypes of helper functions here
 
-//helper function that checks height of a given node (only used on the root)
-int findHeight(Node * root);
-//helper function that checks if height from findHeight() is equal to left/right paths of root
-bool checkEqualPaths(Node * root, int height, int pathLength);
-
 bool equalPaths(Node * root)
 {
     // Add your code below
@@ -21,51 +19,47 @@ bool equalPaths(Node * root)
     if (root == nullptr) {
         return true;
     }
-  //If there is only a root, then all paths are the same length
-    if (root->left == nullptr && root->right == nullptr) {
-        return true;
-    }
-
-    //all paths' heights should be equal to depth
-    int targetHeight = findHeight(root);
-
-    return checkEqualPaths(root, targetHeight, 0);
-
-}
-
-//helper function that checks height of a given node (only used on the root)
-int findHeight(Node * root)
-{
-    if (root == nullptr) {
-        return -1;
-    }
-
-    if (root->left == nullptr && root->right == nullptr) {
-        return 0;
-    }
-
-    if (root->left != nullptr) {
-        return 1 + findHeight(root->left);
-    }
-    
-    
-    return 1 + findHeight(root->right);
-
-    
-}
-
-//helper function that checks if height from findHeight() is equal to left/right paths of root
-bool checkEqualPaths(Node * root, int height, int pathLength)
-{
-    if (root == nullptr) {
-        return true;
-    }
 
-    if (root->left == nullptr && root->right == nullptr) {
-        return pathLength == height;
+    // One depth-first pass with an explicit stack, so a degenerate tree
+    // (a million-node chain) cannot overflow the call stack. The walk
+    // follows left children directly and only stacks the right ones it
+    // still has to visit. The first leaf reached fixes the depth every
+    // other leaf must have, and the walk stops at the first node that
+    // contradicts it: a leaf at another depth, or an inner node at or
+    // below that depth (its leaves are deeper).
+    vector<pair<Node*, int> > pending;
+    Node* node = root;
+    int depth = 0;
+    int leafDepth = INT_MAX;  // until the first leaf
+    while (true) {
+        if (node->left == nullptr && node->right == nullptr) {
+            if (leafDepth == INT_MAX) {
+                leafDepth = depth;
+            }
+            else if (depth != leafDepth) {
+                return false;
+            }
+            if (pending.empty()) {
+                break;
+            }
+            node = pending.back().first;
+            depth = pending.back().second;
+            pending.pop_back();
+            continue;
+        }
+        if (depth >= leafDepth) {
+            return false;
+        }
+        if (node->left == nullptr) {
+            node = node->right;
+        }
+        else {
+            if (node->right != nullptr) {
+                pending.push_back(make_pair(node->right, depth + 1));
+            }
+            node = node->left;
+        }
+        depth++;
     }
-
-    return checkEqualPaths(root->left, height, pathLength + 1) &&
-           checkEqualPaths(root->right, height, pathLength + 1);
+    return true;
 }
-
@@ -0,0 +1,129 @@
+#ifndef INTERVALTREE_H
+#define INTERVALTREE_H
+
+#include <iostream>
+#include <vector>
+#include <limits>
+
+#include "augmentedavl.h"
+
+/**
+* A half-open interval [start, end), ordered by start and then by end,
+* so intervals sharing a start are separate keys.
+*/
+template <typename T>
+struct Interval
+{
+    Interval() : start(), end() { }
+    Interval(const T& start, const T& end) : start(start), end(end) { }
+
+    bool operator<(const Interval& other) const
+    {
+        return start < other.start || (!(other.start < start) && end < other.end);
+    }
+    bool operator==(const Interval& other) const
+    {
+        return !(*this < other) && !(other < *this);
+    }
+
+    T start;
+    T end;
+};
+
+template <typename T>
+std::ostream& operator<<(std::ostream& os, const Interval<T>& interval)
+{
+    return os << "[" << interval.start << ", " << interval.end << ")";
+}
+
+/**
+* The aggregate an IntervalTree keeps: the largest end in the subtree.
+*/
+template <typename T>
+struct MaxEndAggregate
+{
+    typedef T value_type;
+    static T identity() { return std::numeric_limits<T>::lowest(); }
+    static T combine(const T& a, const T& b) { return a < b ? b : a; }
+    template <typename Value>
+    static T lift(const Interval<T>& key, const Value&) { return key.end; }
+};
+
+/**
+* An AugmentedAVLTree over intervals that keeps the largest end point of
+* each subtree, which the rotations maintain like any other aggregate.
+* A query walks the tree in order and skips every subtree that ends too
+* early or starts too late, so it visits O(log n) nodes plus, at worst,
+* O(log n) per interval reported; with few intervals nested inside one
+* another it is close to O(log n + k).
+*
+* Inserting an interval that is already there overwrites its value.
+*/
+template <class T, class Value>
+class IntervalTree : public AugmentedAVLTree<Interval<T>, Value, MaxEndAggregate<T> >
+{
+public:
+    typedef typename AugmentedAVLTree<Interval<T>, Value, MaxEndAggregate<T> >::iterator iterator;
+
+    void stab(const T& point, std::vector<iterator>& out) const;
+    void overlapping(const T& lo, const T& hi, std::vector<iterator>& out) const;
+    void swap(IntervalTree& other);
+
+protected:
+    void collect(Node<Interval<T>, Value>* node, const T& lo, const T& hi, bool point,
+                 std::vector<iterator>& out) const;
+};
+
+/**
+* Appends to out, in key order, every interval that contains point.
+*/
+template<class T, class Value>
+void IntervalTree<T, Value>::stab(const T& point, std::vector<iterator>& out) const
+{
+    collect(this->root_, point, point, true, out);
+}
+
+/**
+* Appends to out, in key order, every interval that shares a point with
+* [lo, hi). An empty query range overlaps nothing.
+*/
+template<class T, class Value>
+void IntervalTree<T, Value>::overlapping(const T& lo, const T& hi, std::vector<iterator>& out) const
+{
+    if (lo < hi)
+        collect(this->root_, lo, hi, false, out);
+}
+
+/**
+* Reports the intervals under node that end after lo and start before hi,
+* or at it for a stabbing query. Recurses only to the left; to the right
+* it loops, so the depth is at most the height of the tree.
+*/
+template<class T, class Value>
+void IntervalTree<T, Value>::collect(Node<Interval<T>, Value>* node, const T& lo, const T& hi, bool point,
+                                     std::vector<iterator>& out) const
+{
+    while (node != nullptr && lo < this->aggregateOf(node)) {
+        collect(node->getLeft(), lo, hi, point, out);
+        const Interval<T>& interval = node->getKey();
+        if (point ? hi < interval.start : !(interval.start < hi))
+            return;
+        if (lo < interval.end)
+            out.push_back(this->iteratorAt(node));
+        node = node->getRight();
+    }
+}
+
+template<class T, class Value>
+void IntervalTree<T, Value>::swap(IntervalTree& other)
+{
+    this->swapTrees(other);
+}
+
+template<class T, class Value>
+void swap(IntervalTree<T, Value>& a, IntervalTree<T, Value>& b)
+{
+    a.swap(b);
+}
+
+#endif
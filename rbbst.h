@@ -0,0 +1,595 @@
+#ifndef RBBST_H
+#define RBBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+
+#include "bst.h"
+
+/**
+* A node for a Red-Black tree, which adds the color as a data member.
+* Null children are treated as black.
+*/
+template <typename Key, typename Value>
+class RBNode : public Node<Key, Value>
+{
+public:
+    enum Color { RED = 0, BLACK = 1 };
+
+    // Constructor/destructor.
+    RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent);
+    virtual ~RBNode();
+
+    // Getter/setter for the node's color.
+    Color getColor() const;
+    void setColor(Color color);
+    bool isRed() const;
+
+    // Getters for parent, left, and right. These need to be redefined since they
+    // return pointers to RBNodes - not plain Nodes.
+    virtual RBNode<Key, Value>* getParent() const override;
+    virtual RBNode<Key, Value>* getLeft() const override;
+    virtual RBNode<Key, Value>* getRight() const override;
+    virtual size_t nodeSize() const override;
+    virtual Node<Key, Value>* copyTo(void* where) const override;
+
+protected:
+    uint8_t color_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the RBNode class.
+  -------------------------------------------------
+*/
+
+/**
+* An explicit constructor; new nodes start out red.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const Key& key, const Value& value, RBNode<Key, Value> *parent) :
+    Node<Key, Value>(key, value, parent), color_(RED)
+{
+
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::~RBNode()
+{
+
+}
+
+/**
+* A getter for the color of a RBNode.
+*/
+template<class Key, class Value>
+typename RBNode<Key, Value>::Color RBNode<Key, Value>::getColor() const
+{
+    return static_cast<Color>(color_);
+}
+
+/**
+* A setter for the color of a RBNode.
+*/
+template<class Key, class Value>
+void RBNode<Key, Value>::setColor(Color color)
+{
+    color_ = static_cast<uint8_t>(color);
+}
+
+/**
+* Returns true if the node is red.
+*/
+template<class Key, class Value>
+bool RBNode<Key, Value>::isRed() const
+{
+    return color_ == RED;
+}
+
+/**
+* An overridden function for getting the parent since a static_cast is necessary to make sure
+* that our node is a RBNode.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getParent() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->parent_);
+}
+
+/**
+* Overridden for the same reasons as above.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getLeft() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->left_);
+}
+
+/**
+* Overridden for the same reasons as above.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getRight() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->right_);
+}
+
+/**
+* Overridden so compact() copies the whole RBNode.
+*/
+template<class Key, class Value>
+size_t RBNode<Key, Value>::nodeSize() const
+{
+    return sizeof(RBNode<Key, Value>);
+}
+
+template<class Key, class Value>
+Node<Key, Value>* RBNode<Key, Value>::copyTo(void* where) const
+{
+    return new (where) RBNode<Key, Value>(*this);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the RBNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A Red-Black tree. Compared to the AVLTree it keeps a looser balance
+* (height <= 2*log2(n+1)) but never performs more than 2 rotations per
+* insert and 3 rotations per remove.
+*/
+template <class Key, class Value>
+class RedBlackTree : public BinarySearchTree<Key, Value>
+{
+public:
+    typedef typename BinarySearchTree<Key, Value>::iterator iterator;
+    typedef NodeHandle<Key, Value, RBNode<Key, Value> > node_handle;
+
+    virtual void insert (const std::pair<const Key, Value> &new_item);
+    virtual iterator insert (iterator hint, const std::pair<const Key, Value> &new_item);
+    std::pair<iterator, bool> insert (node_handle&& nh);
+    node_handle extract(const Key& key);
+    virtual void remove(const Key& key);
+    virtual void rebalance();
+    void swap(RedBlackTree& other);
+protected:
+    virtual void nodeSwap( RBNode<Key,Value>* n1, RBNode<Key,Value>* n2);
+    virtual Node<Key, Value>* detach(Node<Key, Value>* n);
+    virtual std::pair<iterator, bool> adopt(Node<Key, Value>* n);
+    virtual const std::type_info& nodeType() const;
+    virtual void exportFields(std::ostream& os, Node<Key, Value>* node, bool json) const;
+    virtual Node<Key, Value>* cutRange(const Key& lo, const Key* hi);
+
+    void rotateLeft(RBNode<Key, Value>* node);
+    void rotateRight(RBNode<Key, Value>* node);
+    void insertFix(RBNode<Key, Value>* node);
+    void removeFix(RBNode<Key, Value>* node, RBNode<Key, Value>* parent, bool isLeftChild);
+    static bool isRed(RBNode<Key, Value>* node);
+
+};
+
+/**
+* Null children count as black.
+*/
+template <class Key, class Value>
+bool RedBlackTree<Key, Value>::isRed(RBNode<Key, Value>* node)
+{
+    return node != nullptr && node->isRed();
+}
+
+template <class Key, class Value>
+void RedBlackTree<Key, Value>::rotateLeft(RBNode<Key, Value>* node) {
+    RBNode<Key, Value>* rightChild = node->getRight();
+    if (!rightChild) return;
+    this->rotations_++;
+
+    node->setRight(rightChild->getLeft());
+    if (rightChild->getLeft() != nullptr)
+        rightChild->getLeft()->setParent(node);
+
+    RBNode<Key, Value>* parent = node->getParent();
+    rightChild->setParent(parent);
+    if (parent != nullptr) {
+        if (parent->getLeft() == node)
+            parent->setLeft(rightChild);
+        else
+            parent->setRight(rightChild);
+    } else {
+        this->root_ = rightChild;
+    }
+
+    rightChild->setLeft(node);
+    node->setParent(rightChild);
+}
+
+template <class Key, class Value>
+void RedBlackTree<Key, Value>::rotateRight(RBNode<Key, Value>* node) {
+    RBNode<Key, Value>* leftChild = node->getLeft();
+    if (!leftChild) return;
+    this->rotations_++;
+
+    node->setLeft(leftChild->getRight());
+    if (leftChild->getRight() != nullptr)
+        leftChild->getRight()->setParent(node);
+
+    RBNode<Key, Value>* parent = node->getParent();
+    leftChild->setParent(parent);
+    if (parent != nullptr) {
+        if (parent->getLeft() == node)
+            parent->setLeft(leftChild);
+        else
+            parent->setRight(leftChild);
+    } else {
+        this->root_ = leftChild;
+    }
+
+    leftChild->setRight(node);
+    node->setParent(leftChild);
+}
+
+template <class Key, class Value>
+void RedBlackTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item) {
+    BST_TIMED(insertLatency);
+    if (this->root_ == nullptr) {
+        RBNode<Key, Value>* newRoot = this->template createNode<RBNode<Key, Value> >(new_item.first, new_item.second, nullptr);
+        newRoot->setColor(RBNode<Key, Value>::BLACK);
+        this->root_ = newRoot;
+        return;
+    }
+
+    Node<Key, Value>* parentNode;
+    RBNode<Key, Value>* current = static_cast<RBNode<Key, Value>*>(this->descend(new_item.first, this->root_, parentNode));
+    if (current != nullptr) {
+        current->setValue(new_item.second);
+        return;
+    }
+    RBNode<Key, Value>* parent = static_cast<RBNode<Key, Value>*>(parentNode);
+    bool wentLeft = new_item.first < parent->getKey();
+
+    RBNode<Key, Value>* newNode = this->template createNode<RBNode<Key, Value> >(new_item.first, new_item.second, parent);
+    if (wentLeft)
+        parent->setLeft(newNode);
+    else
+        parent->setRight(newNode);
+
+    insertFix(newNode);
+}
+
+/**
+* Inserts new_item, starting the search for its position at hint (see
+* BinarySearchTree::fingerStart). Returns an iterator to the item.
+*/
+template <class Key, class Value>
+typename RedBlackTree<Key, Value>::iterator
+RedBlackTree<Key, Value>::insert(iterator hint, const std::pair<const Key, Value>& new_item) {
+    BST_TIMED(insertLatency);
+    if (this->root_ == nullptr) {
+        insert(new_item);
+        return this->iteratorAt(this->root_);
+    }
+
+    Node<Key, Value>* parentNode;
+    RBNode<Key, Value>* current = static_cast<RBNode<Key, Value>*>(
+        this->descend(new_item.first, this->fingerStart(hint, new_item.first), parentNode));
+    if (current != nullptr) {
+        current->setValue(new_item.second);
+        return this->iteratorAt(current);
+    }
+    RBNode<Key, Value>* parent = static_cast<RBNode<Key, Value>*>(parentNode);
+    bool wentLeft = new_item.first < parent->getKey();
+
+    RBNode<Key, Value>* newNode = this->template createNode<RBNode<Key, Value> >(new_item.first, new_item.second, parent);
+    if (wentLeft)
+        parent->setLeft(newNode);
+    else
+        parent->setRight(newNode);
+
+    insertFix(newNode);
+    return this->iteratorAt(newNode);
+}
+
+/**
+* Restores the red-black properties after linking in the red node.
+* Recoloring may climb toward the root, but at most 2 rotations happen.
+*/
+template <class Key, class Value>
+void RedBlackTree<Key, Value>::insertFix(RBNode<Key, Value>* node) {
+    RBNode<Key, Value>* parent = node->getParent();
+    while (isRed(parent)) {
+        // a red parent is never the root, so the grandparent exists
+        RBNode<Key, Value>* grand = parent->getParent();
+        if (parent == grand->getLeft()) {
+            RBNode<Key, Value>* uncle = grand->getRight();
+            if (isRed(uncle)) {
+                parent->setColor(RBNode<Key, Value>::BLACK);
+                uncle->setColor(RBNode<Key, Value>::BLACK);
+                grand->setColor(RBNode<Key, Value>::RED);
+                node = grand;
+                parent = node->getParent();
+                continue;
+            }
+            if (node == parent->getRight()) {
+                rotateLeft(parent);
+                node = parent;
+                parent = node->getParent();
+            }
+            parent->setColor(RBNode<Key, Value>::BLACK);
+            grand->setColor(RBNode<Key, Value>::RED);
+            rotateRight(grand);
+        } else {
+            RBNode<Key, Value>* uncle = grand->getLeft();
+            if (isRed(uncle)) {
+                parent->setColor(RBNode<Key, Value>::BLACK);
+                uncle->setColor(RBNode<Key, Value>::BLACK);
+                grand->setColor(RBNode<Key, Value>::RED);
+                node = grand;
+                parent = node->getParent();
+                continue;
+            }
+            if (node == parent->getLeft()) {
+                rotateRight(parent);
+                node = parent;
+                parent = node->getParent();
+            }
+            parent->setColor(RBNode<Key, Value>::BLACK);
+            grand->setColor(RBNode<Key, Value>::RED);
+            rotateLeft(grand);
+        }
+        break;
+    }
+    static_cast<RBNode<Key, Value>*>(this->root_)->setColor(RBNode<Key, Value>::BLACK);
+}
+
+/**
+* Links the node owned by nh into the tree and recolors it. If the key is
+* already present nothing changes and nh keeps its node.
+*/
+template <class Key, class Value>
+std::pair<typename RedBlackTree<Key, Value>::iterator, bool>
+RedBlackTree<Key, Value>::insert(node_handle&& nh) {
+    return this->insertHandle(nh);
+}
+
+template <class Key, class Value>
+typename RedBlackTree<Key, Value>::node_handle
+RedBlackTree<Key, Value>::extract(const Key& key) {
+    return this->template extractHandle<node_handle>(key);
+}
+
+template <class Key, class Value>
+std::pair<typename RedBlackTree<Key, Value>::iterator, bool>
+RedBlackTree<Key, Value>::adopt(Node<Key, Value>* n) {
+    RBNode<Key, Value>* newNode = static_cast<RBNode<Key, Value>*>(n);
+
+    Node<Key, Value>* parentNode;
+    Node<Key, Value>* existing = this->descend(newNode->getKey(), this->root_, parentNode);
+    if (existing != nullptr)
+        return std::make_pair(this->iteratorAt(existing), false);
+    RBNode<Key, Value>* parent = static_cast<RBNode<Key, Value>*>(parentNode);
+    bool wentLeft = parent != nullptr && newNode->getKey() < parent->getKey();
+
+    this->indexNode(newNode);
+    this->size_++;
+    newNode->setParent(parent);
+    newNode->setColor(RBNode<Key, Value>::RED);
+    if (parent == nullptr)
+        this->root_ = newNode;
+    else if (wentLeft)
+        parent->setLeft(newNode);
+    else
+        parent->setRight(newNode);
+
+    insertFix(newNode);
+    return std::make_pair(this->iteratorAt(newNode), true);
+}
+
+template <class Key, class Value>
+const std::type_info& RedBlackTree<Key, Value>::nodeType() const {
+    return typeid(RBNode<Key, Value>);
+}
+
+template <class Key, class Value>
+void RedBlackTree<Key, Value>::remove(const Key& key) {
+    BST_TIMED(removeLatency);
+    Node<Key, Value>* node = this->internalFind(key);
+    if (node != nullptr)
+        this->freeNode(detach(node));
+}
+
+/**
+* Detaches the range one node at a time, chaining the nodes into a vine
+* for freeSubtree(). Red-black split and join would need black heights
+* along the cut, which the nodes do not store. One descent finds the
+* first node; each one after it is the successor of the last, taken
+* before the detach. detach() only relinks nodes (see nodeSwap()), so
+* that pointer stays good. The steps add up to O(k + log n), but each
+* detach() is still O(log n) at worst, for the predecessor search and
+* the recoloring climb, so the cut is O(k log n) at worst.
+*/
+template <class Key, class Value>
+Node<Key, Value>* RedBlackTree<Key, Value>::cutRange(const Key& lo, const Key* hi) {
+    Node<Key, Value>* range = nullptr;
+    Node<Key, Value>* tail = nullptr;
+    Node<Key, Value>* node = this->lowerBound(lo);
+    while (node != nullptr && (hi == nullptr || node->getKey() < *hi)) {
+        Node<Key, Value>* next = this->successor(node);
+        detach(node);
+        if (tail == nullptr)
+            range = node;
+        else
+            tail->setRight(node);
+        node->setParent(tail);
+        tail = node;
+        node = next;
+    }
+    return range;
+}
+
+/**
+* Unlinks n from the tree and restores the red-black properties. Like the
+* BST and AVL trees, a node with two children is first swapped with its
+* predecessor. Returns n with its links cleared.
+*/
+template <class Key, class Value>
+Node<Key, Value>* RedBlackTree<Key, Value>::detach(Node<Key, Value>* n) {
+    RBNode<Key, Value>* node = static_cast<RBNode<Key, Value>*>(n);
+
+    if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+        RBNode<Key, Value>* pred = node->getLeft();
+        while (pred->getRight() != nullptr) {
+            pred = pred->getRight();
+        }
+        nodeSwap(node, pred);
+    }
+
+    RBNode<Key, Value>* parent = node->getParent();
+    bool isLeftChild = (parent != nullptr && parent->getLeft() == node);
+    RBNode<Key, Value>* child = (node->getLeft() != nullptr) ? node->getLeft() : node->getRight();
+
+    if (parent == nullptr) {
+        this->root_ = child;
+    } else if (isLeftChild) {
+        parent->setLeft(child);
+    } else {
+        parent->setRight(child);
+    }
+    if (child != nullptr) {
+        child->setParent(parent);
+    }
+
+    bool removedBlack = !node->isRed();
+    node->setParent(nullptr);
+    node->setLeft(nullptr);
+    node->setRight(nullptr);
+
+    if (!removedBlack) {
+        return node;
+    }
+    // a black node with a single child always has a red child; recolor it
+    if (isRed(child)) {
+        child->setColor(RBNode<Key, Value>::BLACK);
+        return node;
+    }
+    removeFix(child, parent, isLeftChild);
+    return node;
+}
+
+/**
+* Fixes the "double black" left behind at node (possibly null), whose
+* parent is parent. Recoloring may climb toward the root, but at most
+* 3 rotations happen.
+*/
+template <class Key, class Value>
+void RedBlackTree<Key, Value>::removeFix(RBNode<Key, Value>* node, RBNode<Key, Value>* parent, bool isLeftChild) {
+    while (parent != nullptr && !isRed(node)) {
+        if (isLeftChild) {
+            RBNode<Key, Value>* sibling = parent->getRight();
+            if (isRed(sibling)) {
+                sibling->setColor(RBNode<Key, Value>::BLACK);
+                parent->setColor(RBNode<Key, Value>::RED);
+                rotateLeft(parent);
+                sibling = parent->getRight();
+            }
+            if (!isRed(sibling->getLeft()) && !isRed(sibling->getRight())) {
+                sibling->setColor(RBNode<Key, Value>::RED);
+                node = parent;
+                parent = node->getParent();
+                isLeftChild = (parent != nullptr && parent->getLeft() == node);
+                continue;
+            }
+            if (!isRed(sibling->getRight())) {
+                sibling->getLeft()->setColor(RBNode<Key, Value>::BLACK);
+                sibling->setColor(RBNode<Key, Value>::RED);
+                rotateRight(sibling);
+                sibling = parent->getRight();
+            }
+            sibling->setColor(parent->getColor());
+            parent->setColor(RBNode<Key, Value>::BLACK);
+            sibling->getRight()->setColor(RBNode<Key, Value>::BLACK);
+            rotateLeft(parent);
+        } else {
+            RBNode<Key, Value>* sibling = parent->getLeft();
+            if (isRed(sibling)) {
+                sibling->setColor(RBNode<Key, Value>::BLACK);
+                parent->setColor(RBNode<Key, Value>::RED);
+                rotateRight(parent);
+                sibling = parent->getLeft();
+            }
+            if (!isRed(sibling->getLeft()) && !isRed(sibling->getRight())) {
+                sibling->setColor(RBNode<Key, Value>::RED);
+                node = parent;
+                parent = node->getParent();
+                isLeftChild = (parent != nullptr && parent->getLeft() == node);
+                continue;
+            }
+            if (!isRed(sibling->getLeft())) {
+                sibling->getRight()->setColor(RBNode<Key, Value>::BLACK);
+                sibling->setColor(RBNode<Key, Value>::RED);
+                rotateLeft(sibling);
+                sibling = parent->getLeft();
+            }
+            sibling->setColor(parent->getColor());
+            parent->setColor(RBNode<Key, Value>::BLACK);
+            sibling->getLeft()->setColor(RBNode<Key, Value>::BLACK);
+            rotateRight(parent);
+        }
+        return;
+    }
+    if (node != nullptr) {
+        node->setColor(RBNode<Key, Value>::BLACK);
+    }
+}
+
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::nodeSwap(RBNode<Key, Value>* n1, RBNode<Key, Value>* n2)
+{
+    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+
+    // Colors belong to the tree positions, not the items, so swap them back
+    typename RBNode<Key, Value>::Color tempC = n1->getColor();
+    n1->setColor(n2->getColor());
+    n2->setColor(tempC);
+}
+
+/**
+* Adds each node's color to the exports.
+*/
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::exportFields(std::ostream& os, Node<Key, Value>* node, bool json) const {
+    const char* color = static_cast<RBNode<Key, Value>*>(node)->isRed() ? "red" : "black";
+    if (json)
+        os << ",\"color\":\"" << color << "\"";
+    else
+        os << "\\n" << color;
+}
+
+/**
+* The tree is always balanced, and rebuilding it would invalidate
+* the node colors, so this does nothing.
+*/
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::rebalance() {
+}
+
+/**
+* Exchanges the contents of two RedBlackTrees in O(1), colors and all.
+*/
+template<class Key, class Value>
+void RedBlackTree<Key, Value>::swap(RedBlackTree& other) {
+    this->swapTrees(other);
+}
+
+template<class Key, class Value>
+void swap(RedBlackTree<Key, Value>& a, RedBlackTree<Key, Value>& b) {
+    a.swap(b);
+}
+
+#endif
@@ -0,0 +1,443 @@
+#ifndef THREADEDAVL_H
+#define THREADEDAVL_H
+
+#include <iostream>
+#include <cstdlib>
+
+#include "avlbst.h"
+
+/**
+* An AVLNode that also links to its in-order predecessor and successor,
+* so iterating from one item to the next is a single pointer load.
+*/
+template <typename Key, typename Value>
+class ThreadedAVLNode : public AVLNode<Key, Value>
+{
+public:
+    ThreadedAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual ~ThreadedAVLNode();
+
+    ThreadedAVLNode<Key, Value>* getPrev() const;
+    ThreadedAVLNode<Key, Value>* getNext() const;
+    void setPrev(ThreadedAVLNode<Key, Value>* prev);
+    void setNext(ThreadedAVLNode<Key, Value>* next);
+    virtual size_t nodeSize() const override;
+    virtual Node<Key, Value>* copyTo(void* where) const override;
+
+protected:
+    ThreadedAVLNode<Key, Value>* prev_;
+    ThreadedAVLNode<Key, Value>* next_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the ThreadedAVLNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+ThreadedAVLNode<Key, Value>::ThreadedAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent), prev_(nullptr), next_(nullptr)
+{
+
+}
+
+template<class Key, class Value>
+ThreadedAVLNode<Key, Value>::~ThreadedAVLNode()
+{
+
+}
+
+/**
+* Returns the node holding the next smaller key, or NULL for the first.
+*/
+template<class Key, class Value>
+ThreadedAVLNode<Key, Value>* ThreadedAVLNode<Key, Value>::getPrev() const
+{
+    return prev_;
+}
+
+/**
+* Returns the node holding the next larger key, or NULL for the last.
+*/
+template<class Key, class Value>
+ThreadedAVLNode<Key, Value>* ThreadedAVLNode<Key, Value>::getNext() const
+{
+    return next_;
+}
+
+template<class Key, class Value>
+void ThreadedAVLNode<Key, Value>::setPrev(ThreadedAVLNode<Key, Value>* prev)
+{
+    prev_ = prev;
+}
+
+template<class Key, class Value>
+void ThreadedAVLNode<Key, Value>::setNext(ThreadedAVLNode<Key, Value>* next)
+{
+    next_ = next;
+}
+
+/**
+* Overridden so compact() copies the whole ThreadedAVLNode.
+*/
+template<class Key, class Value>
+size_t ThreadedAVLNode<Key, Value>::nodeSize() const
+{
+    return sizeof(ThreadedAVLNode<Key, Value>);
+}
+
+template<class Key, class Value>
+Node<Key, Value>* ThreadedAVLNode<Key, Value>::copyTo(void* where) const
+{
+    return new (where) ThreadedAVLNode<Key, Value>(*this);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the ThreadedAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVLTree whose nodes form a doubly linked list in key order. The
+* plain iterator's ++ climbs parent pointers when there is no right
+* child, up to O(log n) steps and as many cache misses; here ++ and --
+* each follow one link. Rotations keep the key order, so only inserts
+* and removes touch the list. Costs two pointers per node.
+*/
+template <class Key, class Value>
+class ThreadedAVLTree : public AVLTree<Key, Value>
+{
+public:
+    typedef NodeHandle<Key, Value, ThreadedAVLNode<Key, Value> > node_handle;
+
+    /**
+    * An iterator that steps along the threads. It converts to and from
+    * the plain iterator, so it can be passed as a hint to insert() and
+    * compared with anything the base tree returns.
+    */
+    class iterator : public BinarySearchTree<Key, Value>::iterator
+    {
+    public:
+        iterator();
+        iterator(const typename BinarySearchTree<Key, Value>::iterator& it);
+
+        iterator& operator++();
+        iterator& operator--();
+
+    protected:
+        friend class ThreadedAVLTree<Key, Value>;
+        explicit iterator(Node<Key, Value>* ptr);
+    };
+
+    ThreadedAVLTree();
+    ThreadedAVLTree(const ThreadedAVLTree& other);
+    ThreadedAVLTree(ThreadedAVLTree&& other);
+    ThreadedAVLTree& operator=(const ThreadedAVLTree& other);
+    ThreadedAVLTree& operator=(ThreadedAVLTree&& other);
+    void swap(ThreadedAVLTree& other);
+
+    iterator begin() const;
+    iterator end() const;
+    iterator last() const;
+    iterator find(const Key& key) const;
+    iterator find(iterator hint, const Key& key) const;
+
+    virtual void insert(const std::pair<const Key, Value>& new_item);
+    iterator insert(iterator hint, const std::pair<const Key, Value>& new_item);
+    std::pair<iterator, bool> insert(node_handle&& nh);
+    node_handle extract(const Key& key);
+
+protected:
+    virtual AVLNode<Key, Value>* makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual const std::type_info& nodeType() const;
+    virtual void link(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* node, bool left);
+    virtual Node<Key, Value>* detach(Node<Key, Value>* n);
+    virtual void relink(Node<Key, Value>* old, Node<Key, Value>* copy);
+    virtual Node<Key, Value>* cutRange(const Key& lo, const Key* hi);
+    void thread();
+};
+
+/*
+--------------------------------------------------------------
+Begin implementations for the ThreadedAVLTree::iterator class.
+--------------------------------------------------------------
+*/
+
+template<class Key, class Value>
+ThreadedAVLTree<Key, Value>::iterator::iterator() :
+    BinarySearchTree<Key, Value>::iterator()
+{
+
+}
+
+template<class Key, class Value>
+ThreadedAVLTree<Key, Value>::iterator::iterator(const typename BinarySearchTree<Key, Value>::iterator& it) :
+    BinarySearchTree<Key, Value>::iterator(it)
+{
+
+}
+
+template<class Key, class Value>
+ThreadedAVLTree<Key, Value>::iterator::iterator(Node<Key, Value>* ptr) :
+    BinarySearchTree<Key, Value>::iterator(ptr)
+{
+
+}
+
+/**
+* Moves to the next larger key; past the last item this is end().
+*/
+template<class Key, class Value>
+typename ThreadedAVLTree<Key, Value>::iterator&
+ThreadedAVLTree<Key, Value>::iterator::operator++()
+{
+    if (this->current_ != nullptr)
+        this->current_ = static_cast<ThreadedAVLNode<Key, Value>*>(this->current_)->getNext();
+    return *this;
+}
+
+/**
+* Moves to the next smaller key; before the first item this is end(),
+* so a reverse scan runs from last() until it reaches end().
+*/
+template<class Key, class Value>
+typename ThreadedAVLTree<Key, Value>::iterator&
+ThreadedAVLTree<Key, Value>::iterator::operator--()
+{
+    if (this->current_ != nullptr)
+        this->current_ = static_cast<ThreadedAVLNode<Key, Value>*>(this->current_)->getPrev();
+    return *this;
+}
+
+/*
+------------------------------------------------------------
+End implementations for the ThreadedAVLTree::iterator class.
+------------------------------------------------------------
+*/
+
+template<class Key, class Value>
+ThreadedAVLTree<Key, Value>::ThreadedAVLTree() :
+    AVLTree<Key, Value>()
+{
+
+}
+
+/**
+* The structural copy copies each node's links to other's list, so the
+* copy threads its own nodes afterwards. Moves keep the nodes and so
+* the list.
+*/
+template<class Key, class Value>
+ThreadedAVLTree<Key, Value>::ThreadedAVLTree(const ThreadedAVLTree& other) :
+    AVLTree<Key, Value>(other)
+{
+    thread();
+}
+
+template<class Key, class Value>
+ThreadedAVLTree<Key, Value>::ThreadedAVLTree(ThreadedAVLTree&& other) :
+    AVLTree<Key, Value>(std::move(other))
+{
+
+}
+
+template<class Key, class Value>
+ThreadedAVLTree<Key, Value>& ThreadedAVLTree<Key, Value>::operator=(const ThreadedAVLTree& other) {
+    if (this != &other) {
+        AVLTree<Key, Value>::operator=(other);
+        thread();
+    }
+    return *this;
+}
+
+template<class Key, class Value>
+ThreadedAVLTree<Key, Value>& ThreadedAVLTree<Key, Value>::operator=(ThreadedAVLTree&& other) {
+    AVLTree<Key, Value>::operator=(std::move(other));
+    return *this;
+}
+
+template<class Key, class Value>
+typename ThreadedAVLTree<Key, Value>::iterator
+ThreadedAVLTree<Key, Value>::begin() const {
+    return iterator(BinarySearchTree<Key, Value>::begin());
+}
+
+template<class Key, class Value>
+typename ThreadedAVLTree<Key, Value>::iterator
+ThreadedAVLTree<Key, Value>::end() const {
+    return iterator();
+}
+
+/**
+* Returns an iterator to the largest item, or end() if the tree is empty.
+*/
+template<class Key, class Value>
+typename ThreadedAVLTree<Key, Value>::iterator
+ThreadedAVLTree<Key, Value>::last() const {
+    Node<Key, Value>* node = this->root_;
+    while (node != nullptr && node->getRight() != nullptr)
+        node = node->getRight();
+    return iterator(node);
+}
+
+template<class Key, class Value>
+typename ThreadedAVLTree<Key, Value>::iterator
+ThreadedAVLTree<Key, Value>::find(const Key& key) const {
+    return iterator(BinarySearchTree<Key, Value>::find(key));
+}
+
+template<class Key, class Value>
+typename ThreadedAVLTree<Key, Value>::iterator
+ThreadedAVLTree<Key, Value>::find(iterator hint, const Key& key) const {
+    return iterator(BinarySearchTree<Key, Value>::find(hint, key));
+}
+
+// The inserts are restated because the node_handle overload below hides
+// AVLTree's; the hinted one also hands back a threaded iterator.
+template<class Key, class Value>
+void ThreadedAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item) {
+    AVLTree<Key, Value>::insert(new_item);
+}
+
+template<class Key, class Value>
+typename ThreadedAVLTree<Key, Value>::iterator
+ThreadedAVLTree<Key, Value>::insert(iterator hint, const std::pair<const Key, Value>& new_item) {
+    return iterator(AVLTree<Key, Value>::insert(hint, new_item));
+}
+
+template<class Key, class Value>
+std::pair<typename ThreadedAVLTree<Key, Value>::iterator, bool>
+ThreadedAVLTree<Key, Value>::insert(node_handle&& nh) {
+    std::pair<typename AVLTree<Key, Value>::iterator, bool> result = this->insertHandle(nh);
+    return std::make_pair(iterator(result.first), result.second);
+}
+
+template<class Key, class Value>
+typename ThreadedAVLTree<Key, Value>::node_handle
+ThreadedAVLTree<Key, Value>::extract(const Key& key) {
+    return this->template extractHandle<node_handle>(key);
+}
+
+template<class Key, class Value>
+AVLNode<Key, Value>* ThreadedAVLTree<Key, Value>::makeNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) {
+    return this->template createNode<ThreadedAVLNode<Key, Value> >(key, value, static_cast<ThreadedAVLNode<Key, Value>*>(parent));
+}
+
+template<class Key, class Value>
+const std::type_info& ThreadedAVLTree<Key, Value>::nodeType() const {
+    return typeid(ThreadedAVLNode<Key, Value>);
+}
+
+/**
+* A new leaf sits right next to its parent in key order: just before it
+* as a left child, just after it as a right child.
+* @precondition node was made by this tree (or extracted from a
+* ThreadedAVLTree) and is not in any list
+*/
+template<class Key, class Value>
+void ThreadedAVLTree<Key, Value>::link(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* node, bool left) {
+    ThreadedAVLNode<Key, Value>* leaf = static_cast<ThreadedAVLNode<Key, Value>*>(node);
+    ThreadedAVLNode<Key, Value>* p = static_cast<ThreadedAVLNode<Key, Value>*>(parent);
+    if (p != nullptr) {
+        leaf->setPrev(left ? p->getPrev() : p);
+        leaf->setNext(left ? p : p->getNext());
+        if (leaf->getPrev() != nullptr)
+            leaf->getPrev()->setNext(leaf);
+        if (leaf->getNext() != nullptr)
+            leaf->getNext()->setPrev(leaf);
+    }
+    AVLTree<Key, Value>::link(parent, node, left);
+}
+
+/**
+* Takes n out of the list before the AVL removal runs. The removal may
+* swap n with its predecessor first, but nodes keep their items when
+* swapped, so the list is already right.
+*/
+template<class Key, class Value>
+Node<Key, Value>* ThreadedAVLTree<Key, Value>::detach(Node<Key, Value>* n) {
+    ThreadedAVLNode<Key, Value>* node = static_cast<ThreadedAVLNode<Key, Value>*>(n);
+    if (node->getPrev() != nullptr)
+        node->getPrev()->setNext(node->getNext());
+    if (node->getNext() != nullptr)
+        node->getNext()->setPrev(node->getPrev());
+    node->setPrev(nullptr);
+    node->setNext(nullptr);
+    return AVLTree<Key, Value>::detach(n);
+}
+
+/**
+* Also points the list neighbours of a node compact() moved at its copy.
+*/
+template<class Key, class Value>
+void ThreadedAVLTree<Key, Value>::relink(Node<Key, Value>* old, Node<Key, Value>* copy) {
+    ThreadedAVLNode<Key, Value>* node = static_cast<ThreadedAVLNode<Key, Value>*>(copy);
+    if (node->getPrev() != nullptr)
+        node->getPrev()->setNext(node);
+    if (node->getNext() != nullptr)
+        node->getNext()->setPrev(node);
+    AVLTree<Key, Value>::relink(old, copy);
+}
+
+/**
+* Links every node to its in-order neighbours, walking the tree itself.
+*/
+template<class Key, class Value>
+void ThreadedAVLTree<Key, Value>::thread() {
+    ThreadedAVLNode<Key, Value>* prev = nullptr;
+    Node<Key, Value>* node = this->root_;
+    while (node != nullptr && node->getLeft() != nullptr)
+        node = node->getLeft();
+    while (node != nullptr) {
+        ThreadedAVLNode<Key, Value>* current = static_cast<ThreadedAVLNode<Key, Value>*>(node);
+        current->setPrev(prev);
+        current->setNext(nullptr);
+        if (prev != nullptr)
+            prev->setNext(current);
+        prev = current;
+        if (node->getRight() != nullptr) {
+            node = node->getRight();
+            while (node->getLeft() != nullptr)
+                node = node->getLeft();
+        } else {
+            while (node->getParent() != nullptr && node == node->getParent()->getRight())
+                node = node->getParent();
+            node = node->getParent();
+        }
+    }
+}
+
+/**
+* The range is a contiguous stretch of the list, so the nodes on either
+* side of it just point at each other.
+*/
+template<class Key, class Value>
+Node<Key, Value>* ThreadedAVLTree<Key, Value>::cutRange(const Key& lo, const Key* hi) {
+    ThreadedAVLNode<Key, Value>* before = static_cast<ThreadedAVLNode<Key, Value>*>(this->lowerBound(lo))->getPrev();
+    ThreadedAVLNode<Key, Value>* after = hi == nullptr ? nullptr :
+        static_cast<ThreadedAVLNode<Key, Value>*>(this->lowerBound(*hi));
+    if (before != nullptr)
+        before->setNext(after);
+    if (after != nullptr)
+        after->setPrev(before);
+    return AVLTree<Key, Value>::cutRange(lo, hi);
+}
+
+/**
+* Exchanges the contents of two ThreadedAVLTrees in O(1). The threads
+* run between the nodes, which change trees whole, so each list goes
+* with its nodes and needs no rethreading.
+*/
+template<class Key, class Value>
+void ThreadedAVLTree<Key, Value>::swap(ThreadedAVLTree& other) {
+    this->swapTrees(other);
+}
+
+template<class Key, class Value>
+void swap(ThreadedAVLTree<Key, Value>& a, ThreadedAVLTree<Key, Value>& b) {
+    a.swap(b);
+}
+
+#endif
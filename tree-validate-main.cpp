@@ -0,0 +1,47 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include "tree-validate.h"
+using namespace std;
+
+// Checks a serialized tree (see tree-validate.h) without building it.
+//
+//   tree-validate [--level] [file]      reads stdin without a file
+//
+// Exits with 1 if the dump is malformed or out of order.
+
+int main(int argc, char *argv[])
+{
+    bool levelOrder = false;
+    string path;
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "--level") levelOrder = true;
+        else if(arg == "--preorder") levelOrder = false;
+        else if(path.empty() && arg[0] != '-') path = arg;
+        else {
+            cerr << "usage: tree-validate [--preorder|--level] [file]" << endl;
+            return 1;
+        }
+    }
+
+    ifstream file;
+    if(!path.empty()) {
+        file.open(path.c_str(), ios::binary);
+        if(!file) {
+            cerr << "cannot open " << path << endl;
+            return 1;
+        }
+    }
+    istream& in = path.empty() ? cin : file;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    TreeReport report = levelOrder ? validateLevelOrder(in) : validatePreorder(in);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    report.print(cout);
+    cerr << report.bytes << " bytes in " << seconds << " s ("
+         << (seconds > 0 ? report.bytes / seconds / 1e6 : 0) << " MB/s)" << endl;
+    return report.wellFormed && report.ordered ? 0 : 1;
+}
@@ -0,0 +1,322 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <climits>
+
+#include "tree-validate.h"
+using namespace std;
+
+namespace {
+
+enum TokenType { TOKEN_END, TOKEN_NULL, TOKEN_KEY, TOKEN_BAD };
+
+// Splits the stream into tokens, reading it in large chunks; a per-token
+// operator>> would be the bottleneck on multi-GB dumps.
+class TokenReader
+{
+public:
+    explicit TokenReader(istream& in) : in_(in), pos_(0), len_(0), bytes_(0), tokens_(0)
+    {
+
+    }
+
+    TokenType next(long long& key)
+    {
+        int c = skipSeparators();
+        if (c == EOF) {
+            return TOKEN_END;
+        }
+        tokens_++;
+        TokenType type = TOKEN_BAD;
+        if (c == '#') {
+            pos_++;
+            type = TOKEN_NULL;
+        }
+        else if (c == 'n') {
+            type = match("null") ? TOKEN_NULL : TOKEN_BAD;
+        }
+        else {
+            // the key is parsed straight out of the buffer, in unsigned
+            // so that LLONG_MIN's magnitude fits; a key out of range is
+            // bad
+            bool negative = c == '-';
+            if (c == '-' || c == '+') {
+                pos_++;
+                c = peek();
+            }
+            const unsigned long long limit = (unsigned long long)LLONG_MAX + (negative ? 1 : 0);
+            unsigned long long value = 0;
+            int digits = 0;
+            bool overflow = false;
+            while (c >= '0' && c <= '9') {
+                unsigned d = (unsigned)(c - '0');
+                if (value > (limit - d) / 10) {
+                    overflow = true;
+                }
+                else {
+                    value = value * 10 + d;
+                }
+                digits++;
+                pos_++;
+                c = peek();
+            }
+            if (digits > 0 && !overflow) {
+                key = negative && value != 0 ? -(long long)(value - 1) - 1 : (long long)value;
+                type = TOKEN_KEY;
+            }
+        }
+        // anything else up to the next separator spoils the token
+        c = peek();
+        if (c != EOF && !isSeparator(c)) {
+            while (c != EOF && !isSeparator(c)) {
+                pos_++;
+                c = peek();
+            }
+            type = TOKEN_BAD;
+        }
+        return type;
+    }
+
+    // 1-based number of the last token returned
+    uint64_t tokens() const
+    {
+        return tokens_;
+    }
+
+    uint64_t bytes() const
+    {
+        return bytes_;
+    }
+
+private:
+    static bool isSeparator(int c)
+    {
+        return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == ',';
+    }
+
+    int peek()
+    {
+        if (pos_ == len_) {
+            in_.read(buffer_, sizeof(buffer_));
+            len_ = (size_t)in_.gcount();
+            pos_ = 0;
+            bytes_ += len_;
+            if (len_ == 0) {
+                return EOF;
+            }
+        }
+        return (unsigned char)buffer_[pos_];
+    }
+
+    int skipSeparators()
+    {
+        int c = peek();
+        while (c != EOF && isSeparator(c)) {
+            pos_++;
+            c = peek();
+        }
+        return c;
+    }
+
+    bool match(const char* word)
+    {
+        for (; *word != 0; word++) {
+            if (peek() != *word) {
+                return false;
+            }
+            pos_++;
+        }
+        return true;
+    }
+
+    istream& in_;
+    char buffer_[1 << 16];
+    size_t pos_;
+    size_t len_;
+    uint64_t bytes_;
+    uint64_t tokens_;
+};
+
+// Records the first problem only.
+void fail(TreeReport& report, uint64_t token, const string& what)
+{
+    if (report.error.empty()) {
+        ostringstream msg;
+        msg << "token " << token << ": " << what;
+        report.error = msg.str();
+    }
+}
+
+// Notes a leaf at the given depth (0 for the root).
+void leaf(TreeReport& report, int depth, int& leafDepth, uint64_t token)
+{
+    report.leaves++;
+    if (leafDepth == -1) {
+        leafDepth = depth;
+    }
+    else if (depth != leafDepth && report.equalPaths) {
+        report.equalPaths = false;
+        ostringstream msg;
+        msg << "leaf at depth " << depth << ", but an earlier leaf is at depth " << leafDepth;
+        fail(report, token, msg.str());
+    }
+}
+
+// An empty child position still to be read in a preorder dump, with the
+// range of keys its ancestors allow.
+struct Slot
+{
+    int depth;
+    bool hasLow, hasHigh;
+    long long low, high;
+};
+
+}
+
+TreeReport::TreeReport() :
+    wellFormed(true), orderChecked(false), ordered(true), equalPaths(true),
+    height(0), nodes(0), leaves(0), bytes(0)
+{
+
+}
+
+void TreeReport::print(ostream& os) const
+{
+    os << "well formed: " << (wellFormed ? "yes" : "no") << endl;
+    os << "ordered: " << (!orderChecked ? "not checked" : ordered ? "yes" : "no") << endl;
+    os << "equal paths: " << (equalPaths ? "yes" : "no") << endl;
+    os << "height: " << height << "  nodes: " << nodes << "  leaves: " << leaves << endl;
+    if (!error.empty()) {
+        os << "first problem: " << error << endl;
+    }
+}
+
+/**
+* The slot stack holds the empty right children along the current path
+* plus the next slot to fill, so it never exceeds height + 1. A node is a
+* leaf exactly when its key is followed by two empty children.
+*/
+TreeReport validatePreorder(istream& in)
+{
+    TreeReport report;
+    report.orderChecked = true;
+    TokenReader reader(in);
+    vector<Slot> slots;
+    Slot root = { 0, false, false, 0, 0 };
+    slots.push_back(root);
+    int leafDepth = -1;
+    int lastKeyDepth = 0;
+    int nullsSinceKey = 2;
+
+    long long key;
+    TokenType type;
+    while (!slots.empty() && (type = reader.next(key)) != TOKEN_END) {
+        if (type == TOKEN_BAD) {
+            report.wellFormed = false;
+            fail(report, reader.tokens(), "not a key or empty child");
+            break;
+        }
+        Slot slot = slots.back();
+        slots.pop_back();
+        if (type == TOKEN_NULL) {
+            if (++nullsSinceKey == 2) {
+                leaf(report, lastKeyDepth, leafDepth, reader.tokens());
+            }
+            continue;
+        }
+
+        report.nodes++;
+        if (slot.depth + 1 > report.height) {
+            report.height = slot.depth + 1;
+        }
+        if ((slot.hasLow && key <= slot.low) || (slot.hasHigh && key >= slot.high)) {
+            if (report.ordered) {
+                report.ordered = false;
+                ostringstream msg;
+                msg << "key " << key << " is outside the range allowed by its ancestors";
+                fail(report, reader.tokens(), msg.str());
+            }
+        }
+        lastKeyDepth = slot.depth;
+        nullsSinceKey = 0;
+        Slot right = { slot.depth + 1, true, slot.hasHigh, key, slot.high };
+        Slot left = { slot.depth + 1, slot.hasLow, true, slot.low, key };
+        slots.push_back(right);
+        slots.push_back(left);
+    }
+
+    if (report.wellFormed && !slots.empty()) {
+        report.wellFormed = false;
+        fail(report, reader.tokens(), "the dump ends inside the tree");
+    }
+    else if (report.wellFormed && reader.next(key) != TOKEN_END) {
+        report.wellFormed = false;
+        fail(report, reader.tokens(), "data after the end of the tree");
+    }
+    report.bytes = reader.bytes();
+    return report;
+}
+
+/**
+* Level d + 1 holds two tokens for every key of level d, in order, so
+* each aligned pair belongs to one node; an all-empty pair marks that
+* node as a leaf. All that is needed is the number of keys per level.
+* Leaves at different depths show up as an empty pair in a level that
+* also has keys.
+*/
+TreeReport validateLevelOrder(istream& in)
+{
+    TreeReport report;
+    TokenReader reader(in);
+    int leafDepth = -1;
+    uint64_t slots = 1;     // tokens in the current level
+    int depth = 0;
+    bool ended = false;     // the stream ran out; the rest are empty
+
+    long long key;
+    while (slots > 0 && report.wellFormed) {
+        uint64_t keys = 0;
+        bool pairHasKey = false;
+        for (uint64_t i = 0; i < slots; i++) {
+            TokenType type = ended ? TOKEN_NULL : reader.next(key);
+            if (type == TOKEN_END) {
+                ended = true;
+                type = TOKEN_NULL;
+            }
+            if (type == TOKEN_BAD) {
+                report.wellFormed = false;
+                fail(report, reader.tokens(), "not a key or empty child");
+                break;
+            }
+            if (type == TOKEN_KEY) {
+                keys++;
+                pairHasKey = true;
+            }
+            if (depth > 0 && i % 2 == 1) {
+                if (!pairHasKey) {
+                    leaf(report, depth - 1, leafDepth, reader.tokens());
+                }
+                pairHasKey = false;
+            }
+        }
+        if (keys > 0) {
+            report.nodes += keys;
+            report.height = depth + 1;
+        }
+        slots = 2 * keys;
+        depth++;
+    }
+
+    if (report.wellFormed && !ended) {
+        // only empty children may follow the last level
+        TokenType type;
+        while ((type = reader.next(key)) == TOKEN_NULL) {
+        }
+        if (type != TOKEN_END) {
+            report.wellFormed = false;
+            fail(report, reader.tokens(), "data after the end of the tree");
+        }
+    }
+    report.bytes = reader.bytes();
+    return report;
+}
@@ -0,0 +1,42 @@
+#ifndef TREE_VALIDATE_H
+#define TREE_VALIDATE_H
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+
+// Streaming checks of serialized trees, for dumps too large to build
+// into Nodes just to call equalPaths(). A dump is a sequence of tokens
+// separated by whitespace or commas: an integer key, or "#" / "null"
+// for an empty child.
+//
+//   preorder     node, left subtree, right subtree; every empty child is
+//                written, e.g. "2 1 # # 3 # #"
+//   level order  the tree level by level, two child tokens for every key
+//                of the previous level, e.g. "2 1 3 # # # #"; trailing
+//                empty children may be left out
+//
+// Both read the stream once, in chunks, and allocate no nodes. The
+// preorder check keeps O(height) state, the level-order check O(1).
+
+struct TreeReport
+{
+    TreeReport();
+
+    bool wellFormed;    // the tokens form exactly one tree
+    bool orderChecked;  // preorder only: level order would need O(width) bounds
+    bool ordered;       // every key is inside the range its ancestors allow
+    bool equalPaths;    // all leaves are at the same depth
+    int height;         // number of levels; 0 for the empty tree
+    uint64_t nodes;
+    uint64_t leaves;
+    uint64_t bytes;     // bytes read
+    std::string error;  // the first problem found, if any
+
+    void print(std::ostream& os) const;
+};
+
+TreeReport validatePreorder(std::istream& in);
+TreeReport validateLevelOrder(std::istream& in);
+
+#endif